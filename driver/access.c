@@ -19,6 +19,10 @@
 #include <linux/workqueue.h>
 #include <linux/fs.h> /* Needed for file_operations */
 #include <linux/dma-mapping.h>
+#include <linux/ktime.h>
+#include <linux/moduleparam.h>
+#include <linux/mutex.h>
+#include <linux/uaccess.h>
 
 MODULE_LICENSE("GPL");
 MODULE_AUTHOR("André Costa");
@@ -26,6 +30,12 @@ MODULE_DESCRIPTION("FPGA DTMF Controller");
 
 #define DEV_NAME			  "de1_io"
 
+static bool soft_model;
+module_param(soft_model, bool, 0444);
+MODULE_PARM_DESC(soft_model,
+		 "Register a dummy device backed by a software model of the "
+		 "correlator instead of the FPGA");
+
 #define DTMF_REG_BASE			  0x1000
 #define DTMF_MEM_BASE			  0x2000
 #define DTMF_WINDOW_START_ADDR		  DTMF_MEM_BASE
@@ -46,25 +56,209 @@ MODULE_DESCRIPTION("FPGA DTMF Controller");
 #define DTMF_IRQ_STATUS_REG_OFFSET	  DTMF_REG(0x0C)
 #define DTMF_DOT_PRODUCT_LOW_OFFSET	  DTMF_REG(0x10)
 #define DTMF_DOT_PRODUCT_HIGH_OFFSET	  DTMF_REG(0x14)
-
-/* Window1 start offset */
+/* Number of references the best one is picked from */
+#define DTMF_NB_REFERENCES_REG_OFFSET	  DTMF_REG(0x18)
+/* Index of the best reference, CORRELATE_NO_REFERENCE if all dots are 0 */
+#define DTMF_BEST_INDEX_REG_OFFSET	  DTMF_REG(0x1C)
+#define DTMF_BEST_DOT_LOW_OFFSET	  DTMF_REG(0x20)
+/* |dot product| with each reference of the bank, low then high word */
+#define DTMF_MAGNITUDES_START_OFFSET	  DTMF_REG(0x80)
+
+/* Window start offset, the second bank follows the first one */
 #define DTMF_WINDOW_REG_START_OFFSET	  DTMF_REG(0x100)
-/* Window2 start offset */
-#define DTMF_REF_WINDOW_REG_START_OFFSET  DTMF_REG(0x184)
+#define DTMF_WINDOW_BANK_STRIDE		  (MAX_WINDOW_SAMPLES / 2 * 4)
+#define DTMF_WINDOW_BANKS		  2
+/* Reference bank, MAX_REFERENCES windows of MAX_WINDOW_SAMPLES samples */
+#define DTMF_REF_BANK_START_OFFSET	  DTMF_REG(0x800)
+#define DTMF_REF_BANK_STRIDE		  (MAX_WINDOW_SAMPLES / 2 * 4)
+/* The start register selects the reference with its low bits */
+#define DTMF_START_REF_INDEX_MASK	  0x0f
+/* and the window bank to correlate with this one */
+#define DTMF_START_WINDOW_BANK		  0x10
 
 #define DTMF_IRQ_STATUS_CALCULATION_DONE  0x01
 
+/* The correlator answers in a few cycles, this only catches a dead device */
+#define CALCULATION_TIMEOUT_US		  1000
+/* Windows of IOCTL_CORRELATE_WINDOWS copied from and to the user at once */
+#define CORRELATE_CHUNK_WINDOWS		  64
+
+/*
+ * Software model of correlation.vhd, registers addressed in 32 bits words
+ * from DTMF_REG_BASE like in the VHDL
+ */
+struct correlation_model {
+	uint32_t test_reg;
+	uint32_t irq_status;
+	uint64_t dot_product;
+	uint32_t nb_references;
+	uint32_t best_index;
+	uint64_t best_dot;
+	uint64_t magnitudes[MAX_REFERENCES];
+	int16_t window[DTMF_WINDOW_BANKS][MAX_WINDOW_SAMPLES];
+	int16_t refs[MAX_REFERENCES][MAX_WINDOW_SAMPLES];
+};
+
+#define MODEL_WORD(offset)		  (((offset) - DTMF_REG_BASE) / 4)
+#define MODEL_WINDOW_FIRST_WORD		  MODEL_WORD(DTMF_WINDOW_REG_START_OFFSET)
+#define MODEL_REF_BANK_FIRST_WORD	  MODEL_WORD(DTMF_REF_BANK_START_OFFSET)
+#define MODEL_MAGNITUDES_FIRST_WORD	  MODEL_WORD(DTMF_MAGNITUDES_START_OFFSET)
+
 struct dtmf_fpga_controller {
 	void *mem_ptr;
 	uint16_t *signal_addr_user;
-	uint16_t *ref_signal_addr_user;
 	struct miscdevice miscdev;
 	struct device *dev;
 	bool result_pending;
 	uint8_t window_samples;
+	/* References the next load copies, and the ones in the bank */
+	uint8_t nb_references;
+	uint8_t loaded_references;
+	uint8_t ref_index;
+	/*
+	 * Bank of the last window written, the next start correlates it. Once
+	 * started, the next window goes to the other bank
+	 */
+	uint8_t window_bank;
+	bool window_started;
 	bool wr_in_progress;
+	/* Set when loaded with soft_model, replaces the registers */
+	struct correlation_model *model;
+	/*
+	 * Held by every ioctl and read, a calculation or a window list must not
+	 * see the banks or the state above change under it
+	 */
+	struct mutex lock;
 };
 
+static irqreturn_t irq_handler(int irq, void *dev_id);
+
+static uint32_t model_read(struct correlation_model *model, size_t offset)
+{
+	const size_t word = MODEL_WORD(offset);
+
+	if (word >= MODEL_MAGNITUDES_FIRST_WORD &&
+	    word < MODEL_MAGNITUDES_FIRST_WORD + 2 * MAX_REFERENCES) {
+		const uint64_t magnitude =
+			model->magnitudes[(word - MODEL_MAGNITUDES_FIRST_WORD) / 2];
+
+		return word & 1 ? upper_32_bits(magnitude) :
+				  lower_32_bits(magnitude);
+	}
+	switch (word) {
+	case MODEL_WORD(DTMF_ID_REG_OFFSET):
+		return DTMF_EXPECTED_ID;
+	case MODEL_WORD(DTMF_TEST_REG_OFFSET):
+		return model->test_reg;
+	case MODEL_WORD(DTMF_IRQ_STATUS_REG_OFFSET):
+		return model->irq_status;
+	case MODEL_WORD(DTMF_DOT_PRODUCT_LOW_OFFSET):
+		return lower_32_bits(model->dot_product);
+	case MODEL_WORD(DTMF_DOT_PRODUCT_HIGH_OFFSET):
+		return upper_32_bits(model->dot_product);
+	case MODEL_WORD(DTMF_NB_REFERENCES_REG_OFFSET):
+		return model->nb_references;
+	case MODEL_WORD(DTMF_BEST_INDEX_REG_OFFSET):
+		return model->best_index;
+	case MODEL_WORD(DTMF_BEST_DOT_LOW_OFFSET):
+		return lower_32_bits(model->best_dot);
+	case MODEL_WORD(DTMF_BEST_DOT_LOW_OFFSET + 4):
+		return upper_32_bits(model->best_dot);
+	default:
+		return 0xA5A5A5A5;
+	}
+}
+
+/*
+ * Same as the VHDL: every sample of the window and the references is used and
+ * the best reference is the first strictly greater one
+ */
+static void model_calculate(struct correlation_model *model, uint32_t start)
+{
+	const int16_t *window =
+		model->window[start & DTMF_START_WINDOW_BANK ? 1 : 0];
+	size_t i, j;
+
+	model->best_index = CORRELATE_NO_REFERENCE;
+	model->best_dot = 0;
+	for (j = 0; j < MAX_REFERENCES; ++j) {
+		int64_t sum = 0;
+
+		for (i = 0; i < MAX_WINDOW_SAMPLES; ++i) {
+			sum += (int32_t)window[i] * model->refs[j][i];
+		}
+		model->magnitudes[j] = sum < 0 ? -sum : sum;
+		if (j < model->nb_references &&
+		    model->magnitudes[j] > model->best_dot) {
+			model->best_dot = model->magnitudes[j];
+			model->best_index = j;
+		}
+	}
+	model->dot_product =
+		model->magnitudes[start & DTMF_START_REF_INDEX_MASK];
+	model->irq_status |= DTMF_IRQ_STATUS_CALCULATION_DONE;
+}
+
+static void model_write(struct dtmf_fpga_controller *priv, size_t offset,
+			uint32_t value)
+{
+	struct correlation_model *model = priv->model;
+	const size_t word = MODEL_WORD(offset);
+	int16_t *samples = NULL;
+	size_t nb_samples = 0;
+	size_t sample = 0;
+
+	switch (word) {
+	case MODEL_WORD(DTMF_TEST_REG_OFFSET):
+		model->test_reg = value;
+		return;
+	case MODEL_WORD(DTMF_START_CALCULATION_REG_OFFSET):
+		model_calculate(model, value);
+		/* The interrupt line follows the status bit */
+		irq_handler(0, priv);
+		return;
+	case MODEL_WORD(DTMF_IRQ_STATUS_REG_OFFSET):
+		model->irq_status &= ~value;
+		return;
+	case MODEL_WORD(DTMF_NB_REFERENCES_REG_OFFSET):
+		model->nb_references = min_t(uint32_t, value, MAX_REFERENCES);
+		return;
+	}
+
+	if (word >= MODEL_REF_BANK_FIRST_WORD) {
+		samples = model->refs[0];
+		nb_samples = MAX_REFERENCES * MAX_WINDOW_SAMPLES;
+		sample = (word - MODEL_REF_BANK_FIRST_WORD) * 2;
+	} else if (word >= MODEL_WINDOW_FIRST_WORD) {
+		samples = model->window[0];
+		nb_samples = DTMF_WINDOW_BANKS * MAX_WINDOW_SAMPLES;
+		sample = (word - MODEL_WINDOW_FIRST_WORD) * 2;
+	}
+	/* Each register holds two samples, the first one in the low half */
+	if (sample < nb_samples) {
+		samples[sample] = value & 0xffff;
+		samples[sample + 1] = value >> 16;
+	}
+}
+
+static uint32_t dtmf_read(struct dtmf_fpga_controller *priv, size_t offset)
+{
+	if (priv->model) {
+		return model_read(priv->model, offset);
+	}
+	return ioread32(priv->mem_ptr + offset);
+}
+
+static void dtmf_write(struct dtmf_fpga_controller *priv, size_t offset,
+		       uint32_t value)
+{
+	if (priv->model) {
+		model_write(priv, offset, value);
+		return;
+	}
+	iowrite32(value, priv->mem_ptr + offset);
+}
+
 #if 0 /*Disabled as using dma hangs the CPU*/
 static void msgdma_reset(void *reg)
 {
@@ -158,12 +352,22 @@ static ssize_t write_from_user_to_device(struct dtmf_fpga_controller *priv,
 }
 #endif
 
+/* 64 bits result, its high word follows the low one */
+static uint64_t read_result(struct dtmf_fpga_controller *priv,
+			    size_t low_offset)
+{
+	return ((uint64_t)dtmf_read(priv, low_offset + 4) << 32) |
+	       dtmf_read(priv, low_offset);
+}
+
 /**
- * @brief Device file read callback to read the value of the selected register.
+ * @brief Device file read callback to read the results of the last calculation.
  *
  * @param filp  File structure of the char device from which the value is read.
  * @param buf   Userspace buffer to which the value will be copied.
- * @param count Number of available bytes in the userspace buffer.
+ * @param count Number of available bytes in the userspace buffer, a multiple
+ *              of 8: one uint64_t |dot product| per reference, from the
+ *              selected one on.
  * @param ppos  Current cursor position in the file (ignored).
  *
  * @return Number of bytes written in the userspace buffer or 0 if we couldn't
@@ -174,19 +378,33 @@ static ssize_t on_read(struct file *filp, char __user *buf, size_t count,
 {
 	struct dtmf_fpga_controller *priv = container_of(
 		filp->private_data, struct dtmf_fpga_controller, miscdev);
-	uint64_t result = 0;
-	if (buf == NULL || count != sizeof(result)) {
+	uint64_t results[MAX_REFERENCES];
+	const size_t nb_results = count / sizeof(*results);
+	ssize_t ret = 0;
+	size_t i;
+
+	if (buf == NULL || count == 0 || count % sizeof(*results)) {
 		return -EINVAL;
 	}
-	if (priv->result_pending) {
-		return -EAGAIN;
+	if (mutex_lock_interruptible(&priv->lock)) {
+		return -ERESTARTSYS;
+	}
+	if (priv->ref_index + nb_results > MAX_REFERENCES) {
+		ret = -EINVAL;
+	} else if (priv->result_pending) {
+		ret = -EAGAIN;
+	}
+	for (i = 0; ret == 0 && i < nb_results; ++i) {
+		results[i] = read_result(priv, DTMF_MAGNITUDES_START_OFFSET +
+						       (priv->ref_index + i) *
+							       sizeof(*results));
+	}
+	mutex_unlock(&priv->lock);
+	if (ret < 0) {
+		return ret;
 	}
-	result = ((uint64_t)ioread32(priv->mem_ptr +
-				     DTMF_DOT_PRODUCT_HIGH_OFFSET))
-		 << 32;
-	result |= ioread32(priv->mem_ptr + DTMF_DOT_PRODUCT_LOW_OFFSET);
 
-	if (copy_to_user(buf, &result, sizeof(result))) {
+	if (copy_to_user(buf, results, count)) {
 		dev_err(priv->dev, "Copy to user failed\n");
 		return 0;
 	}
@@ -197,21 +415,49 @@ static irqreturn_t irq_handler(int irq, void *dev_id)
 {
 	struct dtmf_fpga_controller *priv =
 		(struct dtmf_fpga_controller *)dev_id;
-	uint32_t irq_status =
-		ioread32(priv->mem_ptr + DTMF_IRQ_STATUS_REG_OFFSET);
+	uint32_t irq_status = dtmf_read(priv, DTMF_IRQ_STATUS_REG_OFFSET);
 
-	iowrite32(irq_status, priv->mem_ptr + DTMF_IRQ_STATUS_REG_OFFSET);
-	priv->result_pending = false;
+	dtmf_write(priv, DTMF_IRQ_STATUS_REG_OFFSET, irq_status);
+	WRITE_ONCE(priv->result_pending, false);
 
 	return IRQ_HANDLED;
 }
 
+/* Each register can hold two samples */
+static void write_window(struct dtmf_fpga_controller *priv,
+			 const uint16_t *samples, size_t register_offset)
+{
+	uint32_t sample = 0;
+	uint32_t reg = 0;
+
+	for (; sample + 1 < priv->window_samples; sample += 2, reg += 4) {
+		uint32_t reg_value = (uint32_t)samples[sample + 1] << 16 |
+				     samples[sample];
+		dtmf_write(priv, register_offset + reg, reg_value);
+	}
+	/*If the number of samples is odd, we have one missing sample that we still need to send*/
+	if (priv->window_samples & 1) {
+		dtmf_write(priv, register_offset + reg, samples[sample]);
+	}
+}
+
+/*
+ * Registers of the bank to write the next window to, never the one a started
+ * calculation reads
+ */
+static size_t next_window_offset(struct dtmf_fpga_controller *priv)
+{
+	if (priv->window_started) {
+		priv->window_bank ^= 1;
+		priv->window_started = false;
+	}
+	return DTMF_WINDOW_REG_START_OFFSET +
+	       priv->window_bank * DTMF_WINDOW_BANK_STRIDE;
+}
+
 static int transfer_window(struct dtmf_fpga_controller *priv,
-			   uint16_t *user_signal, unsigned long buffer_offset,
-			   size_t register_offset)
+			   uint16_t *user_signal, unsigned long buffer_offset)
 {
-	int ret;
-	uint32_t sample, reg;
 	uint16_t *kernel_signal;
 	if (user_signal == NULL) {
 		dev_err(priv->dev,
@@ -223,11 +469,6 @@ static int transfer_window(struct dtmf_fpga_controller *priv,
 			"Trying to set window without setting window size");
 		return -EINVAL;
 	}
-	if (priv->result_pending) {
-		dev_err(priv->dev,
-			"Trying to set window while calculation is in progrss");
-		return -EBUSY;
-	}
 
 	kernel_signal = kmalloc(priv->window_samples * sizeof(*kernel_signal),
 				GFP_KERNEL);
@@ -235,44 +476,225 @@ static int transfer_window(struct dtmf_fpga_controller *priv,
 		dev_err(priv->dev, "Failed to allocate memory for buffer");
 		return -ENOMEM;
 	}
-	ret = copy_from_user(kernel_signal, user_signal + buffer_offset,
-			     priv->window_samples * sizeof(*kernel_signal));
-	if (ret) {
-		return ret;
+	if (copy_from_user(kernel_signal, user_signal + buffer_offset,
+			   priv->window_samples * sizeof(*kernel_signal))) {
+		kfree(kernel_signal);
+		return -EFAULT;
 	}
-	/* Each register can hold two samples */
-	sample = 0;
-	reg = 0;
-	for (; sample < priv->window_samples; sample += 2, reg += 4) {
-		uint32_t reg_value = kernel_signal[sample + 1] << 16 |
-				     kernel_signal[sample];
-		iowrite32(reg_value, priv->mem_ptr + reg + register_offset);
+	write_window(priv, kernel_signal, next_window_offset(priv));
+
+	kfree(kernel_signal);
+
+	return 0;
+}
+
+/*
+ * Copies the references from the user and writes them in the reference bank,
+ * where they stay for every following calculation
+ */
+static int load_references(struct dtmf_fpga_controller *priv,
+			   const uint16_t __user *user_refs)
+{
+	const size_t window_samples = priv->window_samples;
+	uint16_t *refs;
+	size_t j;
+
+	if (window_samples == 0 || priv->nb_references == 0) {
+		dev_err(priv->dev,
+			"Trying to load references without setting their size");
+		return -EINVAL;
 	}
-	/*If the number of samples is odd, we have one missing sample that we still need to send*/
-	if (priv->window_samples & 1) {
-		iowrite32(kernel_signal[sample],
-			  priv->mem_ptr + reg + register_offset);
+	if (priv->result_pending) {
+		return -EBUSY;
 	}
 
-	kfree(kernel_signal);
+	refs = kmalloc_array(priv->nb_references * window_samples,
+			     sizeof(*refs), GFP_KERNEL);
+	if (!refs) {
+		return -ENOMEM;
+	}
+	if (copy_from_user(refs, user_refs,
+			   priv->nb_references * window_samples *
+				   sizeof(*refs))) {
+		kfree(refs);
+		return -EFAULT;
+	}
+	for (j = 0; j < priv->nb_references; ++j) {
+		write_window(priv, refs + j * window_samples,
+			     DTMF_REF_BANK_START_OFFSET +
+				     j * DTMF_REF_BANK_STRIDE);
+	}
+	dtmf_write(priv, DTMF_NB_REFERENCES_REG_OFFSET, priv->nb_references);
+	priv->loaded_references = priv->nb_references;
+	priv->ref_index = 0;
 
+	kfree(refs);
 	return 0;
 }
-/**
- * @brief Device file ioctl callback. This is used to select the register that can
- * then be written or read using the read and write callbacks.
- *
- * @param filp File structure of the char device to which ioctl is performed.
- * @param cmd  Command value of the ioctl
- * @param arg  Optionnal argument of the ioctl
- *
- * @return 0 if ioctl succeed, -EINVAL otherwise.
+
+/*
+ * Correlates the last window written with every loaded reference. The next
+ * one can be written during the calculation, it goes to the other bank
  */
-static long on_ioctl(struct file *filp, unsigned int code, unsigned long value)
+static void start_calculation(struct dtmf_fpga_controller *priv)
 {
-	struct dtmf_fpga_controller *priv = container_of(
-		filp->private_data, struct dtmf_fpga_controller, miscdev);
+	uint32_t start = priv->ref_index;
+
+	if (priv->window_bank) {
+		start |= DTMF_START_WINDOW_BANK;
+	}
+	priv->window_started = true;
+	WRITE_ONCE(priv->result_pending, true);
+	dtmf_write(priv, DTMF_START_CALCULATION_REG_OFFSET, start);
+}
+
+/*
+ * Waits for the results of the started calculation. Waiting on the spot is
+ * cheaper than sleeping, the interrupt comes a few cycles after the start
+ */
+static int wait_calculation(struct dtmf_fpga_controller *priv)
+{
+	const ktime_t deadline = ktime_add_us(ktime_get(),
+					      CALCULATION_TIMEOUT_US);
+
+	while (READ_ONCE(priv->result_pending)) {
+		if (ktime_after(ktime_get(), deadline)) {
+			dev_err(priv->dev, "Calculation timed out");
+			WRITE_ONCE(priv->result_pending, false);
+			return -ETIMEDOUT;
+		}
+		cpu_relax();
+	}
+	return 0;
+}
+
+/*
+ * IOCTL_CORRELATE_WINDOWS: the whole list in one call. The references are
+ * already in the bank and the device picks the best one, each window is an
+ * upload, a start and the read of the best reference. The next window of the
+ * chunk is uploaded while the device correlates the current one
+ */
+static long correlate_windows(struct dtmf_fpga_controller *priv,
+			      struct correlate_windows __user *user_args)
+{
+	struct correlate_windows args;
+	const uint32_t __user *user_offsets;
+	uint8_t __user *user_best;
+	uint64_t __user *user_best_dots;
+	const size_t window_samples = priv->window_samples;
+	uint16_t *window = NULL;
+	uint32_t *offsets = NULL;
+	uint8_t *best = NULL;
+	uint64_t *best_dots = NULL;
+	uint32_t done;
+	long ret = 0;
+
+	if (copy_from_user(&args, user_args, sizeof(args))) {
+		return -EFAULT;
+	}
+	if (!priv->signal_addr_user || window_samples == 0) {
+		dev_err(priv->dev,
+			"Trying to correlate without setting the signals");
+		return -EINVAL;
+	}
+	user_offsets = u64_to_user_ptr(args.offsets);
+	user_best = u64_to_user_ptr(args.best);
+	user_best_dots = u64_to_user_ptr(args.best_dots);
+	if (args.nb_references == 0 ||
+	    args.nb_references > priv->loaded_references) {
+		return -EINVAL;
+	}
+	if (priv->result_pending) {
+		return -EBUSY;
+	}
+	/* The device only compares the references asked for */
+	dtmf_write(priv, DTMF_NB_REFERENCES_REG_OFFSET, args.nb_references);
 
+	window = kmalloc_array(window_samples, sizeof(*window), GFP_KERNEL);
+	offsets = kmalloc_array(CORRELATE_CHUNK_WINDOWS, sizeof(*offsets),
+				GFP_KERNEL);
+	best = kmalloc_array(CORRELATE_CHUNK_WINDOWS, sizeof(*best),
+			     GFP_KERNEL);
+	best_dots = kmalloc_array(CORRELATE_CHUNK_WINDOWS, sizeof(*best_dots),
+				  GFP_KERNEL);
+	if (!window || !offsets || !best || !best_dots) {
+		ret = -ENOMEM;
+		goto free_buffers;
+	}
+
+	for (done = 0; done < args.nb_windows;) {
+		const uint32_t chunk = min_t(uint32_t, args.nb_windows - done,
+					     CORRELATE_CHUNK_WINDOWS);
+		uint32_t i;
+
+		if (copy_from_user(offsets, user_offsets + done,
+				   chunk * sizeof(*offsets))) {
+			ret = -EFAULT;
+			goto free_buffers;
+		}
+		for (i = 0; i < chunk; ++i) {
+			if (offsets[i] > args.signal_samples ||
+			    args.signal_samples - offsets[i] < window_samples) {
+				dev_err(priv->dev,
+					"Window at %u is past the signal (%llu)",
+					offsets[i], args.signal_samples);
+				ret = -EINVAL;
+				goto free_buffers;
+			}
+		}
+		if (copy_from_user(window, priv->signal_addr_user + offsets[0],
+				   window_samples * sizeof(*window))) {
+			ret = -EFAULT;
+			goto free_buffers;
+		}
+		write_window(priv, window, next_window_offset(priv));
+		for (i = 0; i < chunk; ++i) {
+			start_calculation(priv);
+			if (i + 1 < chunk) {
+				if (copy_from_user(window,
+						   priv->signal_addr_user +
+							   offsets[i + 1],
+						   window_samples *
+							   sizeof(*window))) {
+					/* Don't leave a calculation behind */
+					wait_calculation(priv);
+					ret = -EFAULT;
+					goto free_buffers;
+				}
+				write_window(priv, window,
+					     next_window_offset(priv));
+			}
+
+			ret = wait_calculation(priv);
+			if (ret < 0) {
+				goto free_buffers;
+			}
+			best[i] = dtmf_read(priv, DTMF_BEST_INDEX_REG_OFFSET);
+			best_dots[i] = read_result(priv, DTMF_BEST_DOT_LOW_OFFSET);
+		}
+		if (copy_to_user(user_best + done, best,
+				 chunk * sizeof(*best)) ||
+		    copy_to_user(user_best_dots + done, best_dots,
+				 chunk * sizeof(*best_dots))) {
+			ret = -EFAULT;
+			goto free_buffers;
+		}
+		done += chunk;
+		cond_resched();
+	}
+
+free_buffers:
+	kfree(window);
+	kfree(offsets);
+	kfree(best);
+	kfree(best_dots);
+	return ret;
+}
+
+/* on_ioctl with the lock held */
+static long handle_ioctl(struct dtmf_fpga_controller *priv, unsigned int code,
+			 unsigned long value)
+{
 	switch (code) {
 	case IOCTL_SET_WINDOW_SAMPLES:
 		if (value > MAX_WINDOW_SAMPLES) {
@@ -285,37 +707,54 @@ static long on_ioctl(struct file *filp, unsigned int code, unsigned long value)
 		priv->signal_addr_user = (void *)value;
 		dev_info(priv->dev, "Set signal addr: 0x%lx\n", value);
 		return 0;
-	case IOCTL_SET_REF_SIGNAL_ADDR:
-		priv->ref_signal_addr_user = (void *)value;
-		dev_info(priv->dev, "Set ref signal addr: 0x%lx\n", value);
+	case IOCTL_SET_NB_REFERENCES:
+		if (value > MAX_REFERENCES) {
+			return -EINVAL;
+		}
+		priv->nb_references = value;
 		return 0;
+	case IOCTL_SET_REF_SIGNAL_ADDR:
+		dev_info(priv->dev, "Load ref signal: 0x%lx\n", value);
+		return load_references(priv, (void __user *)value);
 	case IOCTL_SET_WINDOW:
-		dev_info(priv->dev, "Transfer window\n");
-		return transfer_window(priv, priv->signal_addr_user, value,
-				       DTMF_WINDOW_REG_START_OFFSET);
-	case IOCTL_SET_REF_WINDOW:
-		dev_info(priv->dev, "Transfer ref window\n");
-		return transfer_window(priv, priv->ref_signal_addr_user, value,
-				       DTMF_REF_WINDOW_REG_START_OFFSET);
+		dev_dbg(priv->dev, "Transfer window\n");
+		return transfer_window(priv, priv->signal_addr_user, value);
+	case IOCTL_SELECT_REFERENCE:
+		if (value >= priv->loaded_references) {
+			return -EINVAL;
+		}
+		priv->ref_index = value;
+		return 0;
 	case IOCTL_START_CALCULATION:
-		dev_info(priv->dev, "Starting calculation\n");
-		priv->result_pending = true;
-		iowrite32(1, priv->mem_ptr + DTMF_START_CALCULATION_REG_OFFSET);
+		dev_dbg(priv->dev, "Starting calculation\n");
+		/* The device ignores a start while it calculates */
+		if (priv->result_pending) {
+			return -EBUSY;
+		}
+		start_calculation(priv);
 		return 0;
+	case IOCTL_CORRELATE_WINDOWS:
+		return correlate_windows(priv, (void __user *)value);
+	case IOCTL_RETIRED_SET_REF_WINDOW:
+		return -ENOTTY;
 	case IOCTL_RESET_DEVICE:
 		dev_info(priv->dev, "Reset device\n");
 		priv->result_pending = false;
 		priv->window_samples = 0;
-		iowrite32(0x1, priv->mem_ptr + DTMF_IRQ_STATUS_REG_OFFSET);
-		/* Clear registers */
-		for (size_t i = 0; i < MAX_WINDOW_SAMPLES / 2; i++) {
-			iowrite32(0, priv->mem_ptr +
-					     DTMF_REF_WINDOW_REG_START_OFFSET +
-					     i);
-		}
-		for (size_t i = 0; i < MAX_WINDOW_SAMPLES / 2; i++) {
-			iowrite32(0, priv->mem_ptr +
-					     DTMF_WINDOW_REG_START_OFFSET + i);
+		priv->nb_references = 0;
+		priv->loaded_references = 0;
+		priv->ref_index = 0;
+		priv->window_bank = 0;
+		priv->window_started = false;
+		dtmf_write(priv, DTMF_IRQ_STATUS_REG_OFFSET, 0x1);
+		/*
+		 * Clear registers. The bank is left as is, the stale end of a
+		 * reference only meets the zeroed end of the window
+		 */
+		for (size_t i = 0;
+		     i < DTMF_WINDOW_BANKS * MAX_WINDOW_SAMPLES / 2; i++) {
+			dtmf_write(priv, DTMF_WINDOW_REG_START_OFFSET + i * 4,
+				   0);
 		}
 		return 0;
 	default:
@@ -324,12 +763,105 @@ static long on_ioctl(struct file *filp, unsigned int code, unsigned long value)
 	return -EINVAL;
 }
 
+/**
+ * @brief Device file ioctl callback. This is used to select the register that can
+ * then be written or read using the read and write callbacks.
+ *
+ * @param filp File structure of the char device to which ioctl is performed.
+ * @param cmd  Command value of the ioctl
+ * @param arg  Optionnal argument of the ioctl
+ *
+ * @return 0 if ioctl succeed, -EINVAL otherwise.
+ */
+static long on_ioctl(struct file *filp, unsigned int code, unsigned long value)
+{
+	struct dtmf_fpga_controller *priv = container_of(
+		filp->private_data, struct dtmf_fpga_controller, miscdev);
+	long ret;
+
+	if (mutex_lock_interruptible(&priv->lock)) {
+		return -ERESTARTSYS;
+	}
+	ret = handle_ioctl(priv, code, value);
+	mutex_unlock(&priv->lock);
+	return ret;
+}
+
 static const struct file_operations fops = {
 	.owner = THIS_MODULE,
 	.read = on_read,
 	.unlocked_ioctl = on_ioctl,
+	.compat_ioctl = compat_ptr_ioctl,
 };
 
+static void setup_controller(struct platform_device *pdev,
+			     struct dtmf_fpga_controller *priv)
+{
+	/* Setup dev and miscdev */
+	platform_set_drvdata(pdev, priv);
+	priv->dev = &pdev->dev;
+	priv->miscdev = (struct miscdevice){
+		.minor = MISC_DYNAMIC_MINOR,
+		.name = DEV_NAME,
+		.fops = &fops,
+	};
+	priv->result_pending = false;
+	mutex_init(&priv->lock);
+}
+
+/* Do some sanity checks to make sure connection with our IP is ok */
+static int check_device(struct dtmf_fpga_controller *priv)
+{
+	const uint32_t test_value = 0x12345678;
+	uint32_t reg_value;
+
+	reg_value = dtmf_read(priv, DTMF_ID_REG_OFFSET);
+	if (reg_value != DTMF_EXPECTED_ID) {
+		dev_err(priv->dev,
+			"Failed to read correct id. Expected %#08x but got %#08x\n",
+			DTMF_EXPECTED_ID, reg_value);
+		return -EIO;
+	}
+
+	dtmf_write(priv, DTMF_TEST_REG_OFFSET, test_value);
+	reg_value = dtmf_read(priv, DTMF_TEST_REG_OFFSET);
+	if (reg_value != test_value) {
+		dev_err(priv->dev,
+			"Error: Read/Write test failed. Expected %#08x but got %#08x\n",
+			test_value, reg_value);
+		return -EIO;
+	}
+	return 0;
+}
+
+/*
+ * Probe of the dummy device registered with soft_model: no registers nor
+ * interrupt, the model stands in for both
+ */
+static int model_probe(struct platform_device *pdev)
+{
+	struct dtmf_fpga_controller *priv;
+	int ret;
+
+	priv = devm_kzalloc(&pdev->dev, sizeof(*priv), GFP_KERNEL);
+	if (unlikely(!priv)) {
+		return -ENOMEM;
+	}
+	priv->model = devm_kzalloc(&pdev->dev, sizeof(*priv->model),
+				   GFP_KERNEL);
+	if (unlikely(!priv->model)) {
+		return -ENOMEM;
+	}
+	setup_controller(pdev, priv);
+
+	ret = check_device(priv);
+	if (ret < 0) {
+		return ret;
+	}
+	dev_info(&pdev->dev, "Using the software model of the correlator");
+	return misc_register(&priv->miscdev);
+}
+
 /**
  * access_probe - Probe function of the platform driver.
  * @pdev:	Pointer to the platform device structure.
@@ -339,9 +871,12 @@ static int access_probe(struct platform_device *pdev)
 {
 	int ret;
 	struct resource *iores;
-	uint32_t test_value = 0x12345678;
-	uint32_t reg_value;
 	int dtmf_interrupt;
+	struct dtmf_fpga_controller *priv;
+
+	if (soft_model) {
+		return model_probe(pdev);
+	}
 #if 0
 	int dma_interrupt = platform_get_irq(pdev, 0);
 
@@ -356,8 +891,7 @@ static int access_probe(struct platform_device *pdev)
 		return dtmf_interrupt;
 	}
 
-	struct dtmf_fpga_controller *priv =
-		devm_kzalloc(&pdev->dev, sizeof(*priv), GFP_KERNEL);
+	priv = devm_kzalloc(&pdev->dev, sizeof(*priv), GFP_KERNEL);
 
 	if (unlikely(!priv)) {
 		dev_err(&pdev->dev,
@@ -381,15 +915,7 @@ static int access_probe(struct platform_device *pdev)
 	BUG_ON(ret);
 #endif
 
-	/* Setup dev and miscdev */
-	platform_set_drvdata(pdev, priv);
-	priv->dev = &pdev->dev;
-	priv->miscdev = (struct miscdevice){
-		.minor = MISC_DYNAMIC_MINOR,
-		.name = DEV_NAME,
-		.fops = &fops,
-	};
-	priv->result_pending = false;
+	setup_controller(pdev, priv);
 
 #if 0
 	init_completion(&priv->dma_transfer_completion);
@@ -415,22 +941,9 @@ static int access_probe(struct platform_device *pdev)
 	msgdma_reset(priv->mem_ptr);
 #endif
 
-	/* Do some sanity checks to make sure connection with our IP is ok*/
-	reg_value = ioread32(priv->mem_ptr + DTMF_ID_REG_OFFSET);
-	if (reg_value != DTMF_EXPECTED_ID) {
-		dev_err(&pdev->dev,
-			"Failed to read correct id. Expected %#08x but got %#08x\n",
-			DTMF_EXPECTED_ID, reg_value);
-		return -EIO;
-	}
-
-	iowrite32(test_value, priv->mem_ptr + DTMF_TEST_REG_OFFSET);
-	reg_value = ioread32(priv->mem_ptr + DTMF_TEST_REG_OFFSET);
-	if (reg_value != test_value) {
-		dev_err(&pdev->dev,
-			"Error: Read/Write test failed. Expected %#08x but got %#08x\n",
-			test_value, reg_value);
-		return -EIO;
+	ret = check_device(priv);
+	if (ret < 0) {
+		return ret;
 	}
 
 	dev_info(&pdev->dev, "Acess probe successful!");
@@ -471,9 +984,32 @@ static struct platform_driver access_driver = {
 	.remove = acess_remove,
 };
 
-/*
- * As init and exit function only have to register and unregister the
- * platform driver, we can use this helper macros that will automatically
- * create the functions.
- */
-module_platform_driver(access_driver);
+/* Stands in for the FPGA when loaded with soft_model */
+static struct platform_device *model_device;
+
+static int __init access_init(void)
+{
+	int ret = platform_driver_register(&access_driver);
+
+	if (ret < 0 || !soft_model) {
+		return ret;
+	}
+	model_device = platform_device_register_simple(
+		DEV_NAME, PLATFORM_DEVID_NONE, NULL, 0);
+	if (IS_ERR(model_device)) {
+		platform_driver_unregister(&access_driver);
+		return PTR_ERR(model_device);
+	}
+	return 0;
+}
+
+static void __exit access_exit(void)
+{
+	if (model_device) {
+		platform_device_unregister(model_device);
+	}
+	platform_driver_unregister(&access_driver);
+}
+
+module_init(access_init);
+module_exit(access_exit);
@@ -1,14 +1,59 @@
 #ifndef ACCESS_H
 #define ACCESS_H
 
-#define IOCTL_SET_WINDOW_SAMPLES  0
-#define IOCTL_SET_SIGNAL_ADDR	  1
-#define IOCTL_SET_REF_SIGNAL_ADDR 6
-#define IOCTL_SET_WINDOW	  3
-#define IOCTL_SET_REF_WINDOW	  4
-#define IOCTL_START_CALCULATION	  5
-#define IOCTL_RESET_DEVICE	  7
+#include <linux/ioctl.h>
+#include <linux/types.h>
+
+/* Type of the ioctls of the device */
+#define DTMF_IOCTL_MAGIC	  0xD7
+
+#define IOCTL_SET_WINDOW_SAMPLES  _IO(DTMF_IOCTL_MAGIC, 0)
+#define IOCTL_SET_SIGNAL_ADDR	  _IO(DTMF_IOCTL_MAGIC, 1)
+/*
+ * Loads the references, IOCTL_SET_NB_REFERENCES consecutive windows, in the
+ * reference bank of the device. They stay there until the next load
+ */
+#define IOCTL_SET_REF_SIGNAL_ADDR _IO(DTMF_IOCTL_MAGIC, 6)
+/*
+ * Writes the window the next start correlates. The device has two window
+ * banks, so this is allowed while it calculates on the previous window
+ */
+#define IOCTL_SET_WINDOW	  _IO(DTMF_IOCTL_MAGIC, 3)
+/*
+ * A calculation correlates the window with every loaded reference, read()
+ * then returns their uint64_t |dot products| from the selected one on
+ */
+#define IOCTL_SELECT_REFERENCE	  _IO(DTMF_IOCTL_MAGIC, 10)
+#define IOCTL_START_CALCULATION	  _IO(DTMF_IOCTL_MAGIC, 5)
+#define IOCTL_RESET_DEVICE	  _IO(DTMF_IOCTL_MAGIC, 7)
+#define IOCTL_CORRELATE_WINDOWS	  _IOW(DTMF_IOCTL_MAGIC, 8, struct correlate_windows)
+/* Number of references IOCTL_SET_REF_SIGNAL_ADDR loads */
+#define IOCTL_SET_NB_REFERENCES	  _IO(DTMF_IOCTL_MAGIC, 9)
+/* 4 was IOCTL_SET_REF_WINDOW, never reused */
+#define IOCTL_RETIRED_SET_REF_WINDOW _IO(DTMF_IOCTL_MAGIC, 4)
 
 #define MAX_WINDOW_SAMPLES	  64
+/* Size of the reference bank of the device */
+#define MAX_REFERENCES		  16
+/* best value of a window whose dot products are all 0 */
+#define CORRELATE_NO_REFERENCE	  0xff
+
+/*
+ * Correlates each window with the first nb_references loaded references and
+ * keeps the best one. The windows are read from the signal set with
+ * IOCTL_SET_SIGNAL_ADDR. The arrays are passed as 64 bits addresses, so that
+ * 32 and 64 bits users share the layout.
+ */
+struct correlate_windows {
+	/* In: sample offset of each window in the signal, __u32 array */
+	__u64 offsets;
+	__u32 nb_windows;
+	__u32 nb_references;
+	/* Out: index of the best reference (__u8) and its dot product (__u64) */
+	__u64 best;
+	__u64 best_dots;
+	/* In: samples in the signal, every window must end inside it */
+	__u64 signal_samples;
+};
 
 #endif /* ACCESS_H */
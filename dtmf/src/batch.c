@@ -0,0 +1,410 @@
+#include "batch.h"
+#include "buffer.h"
+#include "wave.h"
+#include <dirent.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/stat.h>
+#include <time.h>
+
+#define WAVE_EXTENSION ".wav"
+
+typedef struct {
+	char *path;
+	/* NULL if the file couldn't be decoded */
+	char *result;
+	/* Why there is no result, printed in order with the results */
+	const char *error;
+} batch_item_t;
+
+/* Items [begin, end) still waiting to be decoded by a worker */
+typedef struct {
+	pthread_mutex_t lock;
+	size_t begin;
+	size_t end;
+} batch_queue_t;
+
+typedef struct batch_pool batch_pool_t;
+
+typedef struct {
+	pthread_t thread;
+	batch_pool_t *pool;
+	size_t id;
+	batch_queue_t queue;
+	/* Kept from one file to the next so its scratch stays warm */
+	dtmf_decoder_ctx_t *ctx;
+	dtmf_decoder_t *decoder;
+	buffer_t result;
+} batch_worker_t;
+
+struct batch_pool {
+	batch_item_t *items;
+	size_t nb_items;
+	batch_worker_t *workers;
+	size_t nb_workers;
+	dtmf_decode_mode_t mode;
+	/* One context per sample rate, workers share their tables */
+	pthread_mutex_t contexts_lock;
+	buffer_t contexts;
+};
+
+static int load_list(const char *path, buffer_t *items);
+static int load_directory(const char *path, buffer_t *items);
+static int push_item(buffer_t *items, const char *dir, const char *name);
+static bool queue_pop(batch_queue_t *queue, size_t *index);
+static bool queue_steal(batch_pool_t *pool, batch_worker_t *thief);
+static void *batch_worker(void *arg);
+static void decode_item(batch_worker_t *worker, batch_item_t *item);
+static int worker_use_sample_rate(batch_worker_t *worker,
+				  uint32_t sample_rate);
+static void push_result(char c, void *user_data);
+
+int batch_decode(const char *path, dtmf_decode_mode_t mode, size_t nb_threads)
+{
+	buffer_t items;
+	if (buffer_init(&items, 64, sizeof(batch_item_t)) < 0) {
+		fprintf(stderr, "Failed to allocate memory for batch\n");
+		return -1;
+	}
+
+	struct stat st;
+	if (stat(path, &st) < 0) {
+		fprintf(stderr, "Failed to open %s\n", path);
+		buffer_terminate(&items);
+		return -1;
+	}
+	int ret = S_ISDIR(st.st_mode) ? load_directory(path, &items) :
+					load_list(path, &items);
+
+	batch_pool_t pool = {
+		.items = items.data,
+		.nb_items = items.len,
+		.nb_workers = nb_threads == 0 ? 1 : nb_threads,
+		.mode = mode,
+	};
+	if (pool.nb_workers > pool.nb_items) {
+		pool.nb_workers = pool.nb_items == 0 ? 1 : pool.nb_items;
+	}
+	if (ret == 0) {
+		pool.workers = calloc(pool.nb_workers, sizeof(*pool.workers));
+		if (!pool.workers ||
+		    buffer_init(&pool.contexts, 4,
+				sizeof(dtmf_decoder_ctx_t *)) < 0) {
+			fprintf(stderr,
+				"Failed to allocate memory for batch workers\n");
+			free(pool.workers);
+			ret = -1;
+		}
+	}
+
+	if (ret == 0) {
+		struct timespec start, end;
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		pthread_mutex_init(&pool.contexts_lock, NULL);
+
+		/* Contiguous slices so neighbouring files stay on one worker */
+		for (size_t i = 0; i < pool.nb_workers; ++i) {
+			batch_worker_t *worker = &pool.workers[i];
+			worker->pool = &pool;
+			worker->id = i;
+			pthread_mutex_init(&worker->queue.lock, NULL);
+			worker->queue.begin = i * pool.nb_items / pool.nb_workers;
+			worker->queue.end =
+				(i + 1) * pool.nb_items / pool.nb_workers;
+		}
+
+		/*
+		 * The calling thread is worker 0. If a thread fails to start
+		 * its slice simply gets stolen by the others
+		 */
+		size_t started = 1;
+		for (size_t i = 1; i < pool.nb_workers; ++i) {
+			if (pthread_create(&pool.workers[i].thread, NULL,
+					   batch_worker,
+					   &pool.workers[i]) != 0) {
+				fprintf(stderr,
+					"Failed to start batch worker\n");
+				break;
+			}
+			started++;
+		}
+		batch_worker(&pool.workers[0]);
+		for (size_t i = 1; i < started; ++i) {
+			pthread_join(pool.workers[i].thread, NULL);
+		}
+		for (size_t i = started; i < pool.nb_workers; ++i) {
+			/* Items of workers that never ran were stolen */
+			batch_worker(&pool.workers[i]);
+		}
+
+		clock_gettime(CLOCK_MONOTONIC, &end);
+		for (size_t i = 0; i < pool.nb_workers; ++i) {
+			pthread_mutex_destroy(&pool.workers[i].queue.lock);
+		}
+		free(pool.workers);
+		dtmf_decoder_ctx_t **contexts = pool.contexts.data;
+		for (size_t i = 0; i < pool.contexts.len; ++i) {
+			dtmf_decoder_ctx_terminate(contexts[i]);
+		}
+		buffer_terminate(&pool.contexts);
+		pthread_mutex_destroy(&pool.contexts_lock);
+
+		for (size_t i = 0; i < pool.nb_items; ++i) {
+			const batch_item_t *item = &pool.items[i];
+			if (item->result) {
+				printf("%s: %s\n", item->path, item->result);
+			} else {
+				printf("%s: %s\n", item->path,
+				       item->error ? item->error :
+						     "Failed to decode");
+			}
+		}
+		const double time_taken =
+			(end.tv_sec - start.tv_sec) +
+			(end.tv_nsec - start.tv_nsec) / 1e9;
+		fprintf(stderr, "Decoding %zu files on %zu threads took %g seconds\n",
+			pool.nb_items, pool.nb_workers, time_taken);
+	}
+
+	for (size_t i = 0; i < items.len; ++i) {
+		free(pool.items[i].path);
+		free(pool.items[i].result);
+	}
+	buffer_terminate(&items);
+	return ret;
+}
+
+/* One path per line, empty lines are ignored */
+static int load_list(const char *path, buffer_t *items)
+{
+	FILE *fp = fopen(path, "rt");
+	if (!fp) {
+		fprintf(stderr, "Failed to open %s\n", path);
+		return -1;
+	}
+
+	int ret = 0;
+	char *line = NULL;
+	size_t line_capacity = 0;
+	ssize_t len;
+	while ((len = getline(&line, &line_capacity, fp)) >= 0) {
+		while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r')) {
+			line[--len] = '\0';
+		}
+		if (len == 0) {
+			continue;
+		}
+		if (push_item(items, NULL, line) < 0) {
+			ret = -1;
+			break;
+		}
+	}
+
+	free(line);
+	fclose(fp);
+	return ret;
+}
+
+static int is_wave_entry(const struct dirent *entry)
+{
+	const size_t len = strlen(entry->d_name);
+	const size_t ext_len = strlen(WAVE_EXTENSION);
+	return len > ext_len &&
+	       strcasecmp(entry->d_name + len - ext_len, WAVE_EXTENSION) == 0;
+}
+
+/* Every .wav file of the directory, sorted by name */
+static int load_directory(const char *path, buffer_t *items)
+{
+	struct dirent **entries;
+	const int nb_entries = scandir(path, &entries, is_wave_entry, alphasort);
+	if (nb_entries < 0) {
+		fprintf(stderr, "Failed to list %s\n", path);
+		return -1;
+	}
+
+	int ret = 0;
+	for (int i = 0; i < nb_entries; ++i) {
+		if (ret == 0 && push_item(items, path, entries[i]->d_name) < 0) {
+			ret = -1;
+		}
+		free(entries[i]);
+	}
+	free(entries);
+	return ret;
+}
+
+static int push_item(buffer_t *items, const char *dir, const char *name)
+{
+	const size_t dir_len = dir ? strlen(dir) + 1 : 0;
+	const size_t name_len = strlen(name);
+	batch_item_t item = { .path = malloc(dir_len + name_len + 1) };
+	if (!item.path) {
+		fprintf(stderr, "Failed to allocate memory for batch\n");
+		return -1;
+	}
+	if (dir) {
+		memcpy(item.path, dir, dir_len - 1);
+		item.path[dir_len - 1] = '/';
+	}
+	memcpy(item.path + dir_len, name, name_len + 1);
+
+	if (buffer_push(items, &item) < 0) {
+		fprintf(stderr, "Failed to allocate memory for batch\n");
+		free(item.path);
+		return -1;
+	}
+	return 0;
+}
+
+static bool queue_pop(batch_queue_t *queue, size_t *index)
+{
+	pthread_mutex_lock(&queue->lock);
+	const bool found = queue->begin < queue->end;
+	if (found) {
+		*index = queue->begin++;
+	}
+	pthread_mutex_unlock(&queue->lock);
+	return found;
+}
+
+/*
+ * Moves the back half of the first non empty queue found into the thief's.
+ * Returns false once every queue is empty
+ */
+static bool queue_steal(batch_pool_t *pool, batch_worker_t *thief)
+{
+	for (size_t i = 1; i < pool->nb_workers; ++i) {
+		batch_queue_t *victim =
+			&pool->workers[(thief->id + i) % pool->nb_workers].queue;
+
+		pthread_mutex_lock(&victim->lock);
+		const size_t remaining = victim->end - victim->begin;
+		if (remaining == 0) {
+			pthread_mutex_unlock(&victim->lock);
+			continue;
+		}
+		const size_t end = victim->end;
+		const size_t begin = victim->begin + remaining / 2;
+		victim->end = begin;
+		pthread_mutex_unlock(&victim->lock);
+
+		pthread_mutex_lock(&thief->queue.lock);
+		thief->queue.begin = begin;
+		thief->queue.end = end;
+		pthread_mutex_unlock(&thief->queue.lock);
+		return true;
+	}
+	return false;
+}
+
+static void *batch_worker(void *arg)
+{
+	batch_worker_t *worker = arg;
+	batch_pool_t *pool = worker->pool;
+
+	if (buffer_init(&worker->result, 64, sizeof(char)) < 0) {
+		/* Leave this worker's slice to the others */
+		return NULL;
+	}
+
+	size_t index;
+	do {
+		while (queue_pop(&worker->queue, &index)) {
+			decode_item(worker, &pool->items[index]);
+		}
+	} while (queue_steal(pool, worker));
+
+	if (worker->decoder) {
+		dtmf_decoder_terminate(worker->decoder);
+	}
+	dtmf_decoder_ctx_terminate(worker->ctx);
+	buffer_terminate(&worker->result);
+	return NULL;
+}
+
+static void decode_item(batch_worker_t *worker, batch_item_t *item)
+{
+	wave_t wave;
+	if (wave_open(&wave, item->path) < 0) {
+		item->error = "Failed to open";
+		return;
+	}
+	if (wave.channels != 1) {
+		item->error = "Only mono files are batched";
+		wave_close(&wave);
+		return;
+	}
+
+	if (worker_use_sample_rate(worker, wave.sample_rate) < 0) {
+		item->error = "Failed to create decoder";
+		wave_close(&wave);
+		return;
+	}
+
+	worker->result.len = 0;
+	if (dtmf_decoder_feed(worker->decoder, wave.samples, wave.len) == 0) {
+		dtmf_decoder_finish(worker->decoder);
+		if (buffer_push_char(&worker->result, '\0') == 0) {
+			item->result = strdup(worker->result.data);
+		}
+	}
+	wave_close(&wave);
+}
+
+/* Makes sure the worker's decoder is set up for sample_rate */
+static int worker_use_sample_rate(batch_worker_t *worker, uint32_t sample_rate)
+{
+	if (worker->decoder &&
+	    dtmf_decoder_ctx_sample_rate(worker->ctx) == sample_rate) {
+		dtmf_decoder_reset(worker->decoder);
+		return 0;
+	}
+	if (worker->decoder) {
+		dtmf_decoder_terminate(worker->decoder);
+		dtmf_decoder_ctx_terminate(worker->ctx);
+		worker->decoder = NULL;
+		worker->ctx = NULL;
+	}
+
+	batch_pool_t *pool = worker->pool;
+	dtmf_decoder_ctx_t *shared = NULL;
+	pthread_mutex_lock(&pool->contexts_lock);
+	dtmf_decoder_ctx_t **contexts = pool->contexts.data;
+	for (size_t i = 0; i < pool->contexts.len; ++i) {
+		if (dtmf_decoder_ctx_sample_rate(contexts[i]) == sample_rate) {
+			shared = contexts[i];
+			break;
+		}
+	}
+	if (!shared) {
+		shared = dtmf_decoder_ctx_create(sample_rate);
+		if (shared && buffer_push(&pool->contexts, &shared) < 0) {
+			dtmf_decoder_ctx_terminate(shared);
+			shared = NULL;
+		}
+	}
+	/* The tables are read only, only the lookup needs the lock */
+	worker->ctx = shared ? dtmf_decoder_ctx_share(shared) : NULL;
+	pthread_mutex_unlock(&pool->contexts_lock);
+
+	if (!worker->ctx) {
+		return -1;
+	}
+	worker->decoder = dtmf_decoder_create(worker->ctx, pool->mode,
+					      push_result, &worker->result);
+	if (!worker->decoder) {
+		dtmf_decoder_ctx_terminate(worker->ctx);
+		worker->ctx = NULL;
+		return -1;
+	}
+	return 0;
+}
+
+static void push_result(char c, void *user_data)
+{
+	buffer_push_char((buffer_t *)user_data, c);
+}
@@ -0,0 +1,14 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include "dtmf.h"
+#include <stddef.h>
+
+/*
+ * Decodes every wave file listed in path (one path per line) or contained
+ * in the directory path, on nb_threads, and prints one result line per file
+ * in input order
+ */
+int batch_decode(const char *path, dtmf_decode_mode_t mode, size_t nb_threads);
+
+#endif
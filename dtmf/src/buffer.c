@@ -4,7 +4,7 @@
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
-static int reallocate(buffer_t *buffer);
+static int reallocate(buffer_t *buffer, size_t min_capacity);
 
 int buffer_init(buffer_t *buffer, size_t capacity, size_t elem_size)
 {
@@ -16,6 +16,7 @@ int buffer_init(buffer_t *buffer, size_t capacity, size_t elem_size)
 	buffer->data = ptr;
 	buffer->len = 0;
 	buffer->elem_size = elem_size;
+	buffer->owned = true;
 	return 0;
 }
 
@@ -26,11 +27,31 @@ void buffer_construct(buffer_t *buffer, void *data, size_t capacity, size_t len,
 	buffer->capacity = capacity;
 	buffer->len = len;
 	buffer->elem_size = elem_size;
+	buffer->owned = true;
 }
+
+void buffer_construct_view(buffer_t *buffer, const void *data, size_t len,
+			   size_t elem_size)
+{
+	/* The view is never written to, pushing on it fails */
+	buffer->data = (void *)data;
+	buffer->capacity = len;
+	buffer->len = len;
+	buffer->elem_size = elem_size;
+	buffer->owned = false;
+}
+int buffer_reserve(buffer_t *buffer, size_t capacity)
+{
+	if (capacity <= buffer->capacity) {
+		return 0;
+	}
+	return reallocate(buffer, capacity);
+}
+
 int buffer_push(buffer_t *buffer, const void *val)
 {
 	if (buffer->len >= buffer->capacity) {
-		if (reallocate(buffer) < 0) {
+		if (reallocate(buffer, buffer->len + 1) < 0) {
 			return -1;
 		}
 	}
@@ -40,18 +61,63 @@ int buffer_push(buffer_t *buffer, const void *val)
 	buffer->len++;
 	return 0;
 }
+int buffer_append(buffer_t *buffer, const void *src, size_t n)
+{
+	if (buffer_reserve(buffer, buffer->len + n) < 0) {
+		return -1;
+	}
+	memcpy((uint8_t *)buffer->data + (buffer->len * buffer->elem_size), src,
+	       n * buffer->elem_size);
+	buffer->len += n;
+	return 0;
+}
+
+int buffer_append_fill(buffer_t *buffer, const void *val, size_t n)
+{
+	if (buffer_reserve(buffer, buffer->len + n) < 0) {
+		return -1;
+	}
+	uint8_t *dst = (uint8_t *)buffer->data + (buffer->len * buffer->elem_size);
+	const uint8_t *bytes = val;
+	bool all_same = true;
+	for (size_t i = 1; i < buffer->elem_size; ++i) {
+		all_same &= bytes[i] == bytes[0];
+	}
+
+	if (all_same) {
+		/* Covers the zero filled silences */
+		memset(dst, bytes[0], n * buffer->elem_size);
+	} else {
+		for (size_t i = 0; i < n; ++i) {
+			memcpy(dst + i * buffer->elem_size, val,
+			       buffer->elem_size);
+		}
+	}
+	buffer->len += n;
+	return 0;
+}
+
 void buffer_terminate(buffer_t *buffer)
 {
-	free(buffer->data);
+	if (buffer->owned) {
+		free(buffer->data);
+	}
 	buffer->data = NULL;
 	buffer->capacity = 0;
 	buffer->len = 0;
 	buffer->elem_size = 0;
 }
 
-static int reallocate(buffer_t *buffer)
+/* Grows geometrically so repeated pushes stay amortized O(1) */
+static int reallocate(buffer_t *buffer, size_t min_capacity)
 {
-	size_t new_capacity = buffer->capacity * 2;
+	if (!buffer->owned) {
+		return -1;
+	}
+	size_t new_capacity = buffer->capacity ? buffer->capacity * 2 : 1;
+	if (new_capacity < min_capacity) {
+		new_capacity = min_capacity;
+	}
 	void *ptr = realloc(buffer->data, new_capacity * buffer->elem_size);
 	if (!ptr) {
 		return -1;
@@ -2,19 +2,49 @@
 #ifndef BUFFER_H
 #define BUFFER_H
 
+#include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
 
 typedef struct {
 	void *data;
 	size_t capacity; /* In number of elements */
 	size_t len; /* Number of valid elements */
 	size_t elem_size; /* Size of each element */
+	bool owned; /* Whether data is freed on terminate */
 } buffer_t;
 
 int buffer_init(buffer_t *buffer, size_t capacity, size_t elem_size);
 void buffer_construct(buffer_t *buffer, void *data, size_t capacity, size_t len,
 		      size_t elem_size);
+/* Read only view on memory owned by someone else. Can't grow */
+void buffer_construct_view(buffer_t *buffer, const void *data, size_t len,
+			   size_t elem_size);
+/* Makes sure the buffer can hold at least capacity elements */
+int buffer_reserve(buffer_t *buffer, size_t capacity);
 int buffer_push(buffer_t *buffer, const void *val);
+/* Pushes the n elements of src at once */
+int buffer_append(buffer_t *buffer, const void *src, size_t n);
+/* Pushes n copies of val */
+int buffer_append_fill(buffer_t *buffer, const void *val, size_t n);
 void buffer_terminate(buffer_t *buffer);
 
+/*
+ * Typed push for hot loops. Avoids the generic memcpy of elem_size bytes,
+ * the buffer's elem_size must be sizeof(type)
+ */
+#define BUFFER_DEFINE_TYPED_PUSH(suffix, type)                               \
+	static inline int buffer_push_##suffix(buffer_t *buffer, type value) \
+	{                                                                    \
+		if (buffer->len >= buffer->capacity &&                       \
+		    buffer_reserve(buffer, buffer->len + 1) < 0) {           \
+			return -1;                                           \
+		}                                                            \
+		((type *)buffer->data)[buffer->len++] = value;               \
+		return 0;                                                    \
+	}
+
+BUFFER_DEFINE_TYPED_PUSH(char, char)
+BUFFER_DEFINE_TYPED_PUSH(int16, int16_t)
+
 #endif
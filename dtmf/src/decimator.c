@@ -0,0 +1,197 @@
+#include "decimator.h"
+#include "utils.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Input samples filtered per call to the kernels */
+#define DECIMATOR_BLOCK 4096
+/* Pass band edge and transition width, relative to the output rate */
+#define DECIMATOR_CUTOFF     0.425
+#define DECIMATOR_TRANSITION 0.25
+/* Transition width of a Blackman windowed sinc of N taps is about 5.5 / N */
+#define BLACKMAN_TRANSITION_TAPS 5.5
+
+static uint32_t gcd(uint32_t a, uint32_t b);
+static float dot(const float *coeffs, const int16_t *samples, size_t len);
+static int16_t saturate(float value);
+
+int decimator_filter_init(decimator_filter_t *filter, uint32_t in_rate,
+			  uint32_t out_rate, uint32_t max_phases)
+{
+	memset(filter, 0, sizeof(*filter));
+	if (in_rate == 0 || out_rate == 0 || out_rate > in_rate) {
+		printf("Can't decimate from %u Hz to %u Hz\n", in_rate,
+		       out_rate);
+		return -1;
+	}
+	const uint32_t divisor = gcd(in_rate, out_rate);
+	const uint32_t up = out_rate / divisor;
+	const uint32_t down = in_rate / divisor;
+	if (up > max_phases) {
+		return -1;
+	}
+
+	const double transition = DECIMATOR_TRANSITION * out_rate;
+	const size_t taps =
+		(size_t)ceil(BLACKMAN_TRANSITION_TAPS * in_rate / transition);
+	const size_t nb_coeffs = taps * up;
+	double *prototype = malloc(nb_coeffs * sizeof(*prototype));
+	filter->coeffs = malloc(nb_coeffs * sizeof(*filter->coeffs));
+	if (!prototype || !filter->coeffs) {
+		free(prototype);
+		free(filter->coeffs);
+		filter->coeffs = NULL;
+		return -1;
+	}
+
+	/* Cutoff as a fraction of the up sampled rate */
+	const double cutoff =
+		DECIMATOR_CUTOFF * out_rate / ((double)in_rate * up);
+	const double center = (nb_coeffs - 1) / 2.;
+	double sum = 0.;
+	for (size_t i = 0; i < nb_coeffs; ++i) {
+		const double x = i - center;
+		const double sinc = x == 0. ? 2. * cutoff :
+					      sin(2. * M_PI * cutoff * x) /
+						      (M_PI * x);
+		const double phase = 2. * M_PI * i / (nb_coeffs - 1);
+		const double window =
+			0.42 - 0.5 * cos(phase) + 0.08 * cos(2. * phase);
+		prototype[i] = sinc * window;
+		sum += prototype[i];
+	}
+
+	/*
+	 * Zero stuffing divides the gain by up, each phase gets back a unit
+	 * gain. The taps of a phase are stored oldest input sample first
+	 */
+	for (size_t p = 0; p < up; ++p) {
+		for (size_t j = 0; j < taps; ++j) {
+			const size_t k = taps - 1 - j;
+			filter->coeffs[p * taps + j] =
+				up * prototype[p + k * up] / sum;
+		}
+	}
+	free(prototype);
+
+	filter->in_rate = in_rate;
+	filter->out_rate = out_rate;
+	filter->up = up;
+	filter->down = down;
+	filter->taps = taps;
+	return 0;
+}
+
+void decimator_filter_terminate(decimator_filter_t *filter)
+{
+	free(filter->coeffs);
+	filter->coeffs = NULL;
+}
+
+int decimator_init(decimator_t *decimator, const decimator_filter_t *filter)
+{
+	decimator->filter = filter;
+	decimator->work = malloc((filter->taps - 1 + DECIMATOR_BLOCK) *
+				 sizeof(*decimator->work));
+	if (!decimator->work) {
+		return -1;
+	}
+	decimator_reset(decimator);
+	return 0;
+}
+
+void decimator_reset(decimator_t *decimator)
+{
+	const decimator_filter_t *filter = decimator->filter;
+	memset(decimator->work, 0, (filter->taps - 1) * sizeof(*decimator->work));
+	/*
+	 * Starts with the center of the filter on the first sample, the output
+	 * then lines up with the input instead of lagging by half the filter
+	 */
+	decimator->next = (filter->taps * filter->up - 1) / 2;
+}
+
+size_t decimator_max_output(const decimator_t *decimator, size_t n)
+{
+	const decimator_filter_t *filter = decimator->filter;
+	return (n * filter->up) / filter->down + 1;
+}
+
+size_t decimator_process(decimator_t *decimator, const int16_t *in, size_t n,
+			 int16_t *out)
+{
+	const decimator_filter_t *filter = decimator->filter;
+	const size_t taps = filter->taps;
+	const size_t up = filter->up;
+	const size_t down = filter->down;
+	int16_t *work = decimator->work;
+	size_t produced = 0;
+
+	while (n > 0) {
+		const size_t block = MIN(n, DECIMATOR_BLOCK);
+		memcpy(work + taps - 1, in, block * sizeof(*in));
+		size_t next = decimator->next;
+
+		if (up == 1) {
+			/* Integer factor, like 48 kHz to 8 kHz: a single phase */
+			for (; next < block; next += down) {
+				out[produced++] =
+					saturate(dot(filter->coeffs,
+						     work + next, taps));
+			}
+		} else {
+			for (; next / up < block; next += down) {
+				const float *coeffs =
+					filter->coeffs + (next % up) * taps;
+				out[produced++] = saturate(
+					dot(coeffs, work + next / up, taps));
+			}
+		}
+
+		/* Keep the last taps - 1 samples for the next block */
+		memmove(work, work + block, (taps - 1) * sizeof(*work));
+		decimator->next = next - block * up;
+		in += block;
+		n -= block;
+	}
+	return produced;
+}
+
+void decimator_terminate(decimator_t *decimator)
+{
+	free(decimator->work);
+	decimator->work = NULL;
+}
+
+static uint32_t gcd(uint32_t a, uint32_t b)
+{
+	while (b != 0) {
+		const uint32_t r = a % b;
+		a = b;
+		b = r;
+	}
+	return a;
+}
+
+static float dot(const float *coeffs, const int16_t *samples, size_t len)
+{
+	float sum = 0.f;
+	for (size_t i = 0; i < len; ++i) {
+		sum += coeffs[i] * samples[i];
+	}
+	return sum;
+}
+
+static int16_t saturate(float value)
+{
+	const long rounded = lrintf(value);
+	if (rounded > INT16_MAX) {
+		return INT16_MAX;
+	}
+	if (rounded < INT16_MIN) {
+		return INT16_MIN;
+	}
+	return (int16_t)rounded;
+}
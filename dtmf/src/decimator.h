@@ -0,0 +1,47 @@
+#ifndef DECIMATOR_H
+#define DECIMATOR_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Low pass filter and rate change from in_rate to out_rate = in_rate * up /
+ * down. The windowed sinc prototype is split in its up polyphase components,
+ * so only the taps landing on real input samples are computed for each
+ * output. Read only once built, any number of decimators can share it.
+ */
+typedef struct {
+	uint32_t in_rate;
+	uint32_t out_rate;
+	uint32_t up;
+	uint32_t down;
+	size_t taps; /* Per phase */
+	/* up * taps, phase p at p * taps, oldest input sample first */
+	float *coeffs;
+} decimator_filter_t;
+
+/* Streaming state, the input can be given in chunks of any size */
+typedef struct {
+	const decimator_filter_t *filter;
+	/* taps - 1 previous input samples followed by the current block */
+	int16_t *work;
+	/* Position of the next output on the up sampled grid, from work[0] */
+	size_t next;
+} decimator_t;
+
+/* Fails if the rates don't reduce to at most max_phases phases */
+int decimator_filter_init(decimator_filter_t *filter, uint32_t in_rate,
+			  uint32_t out_rate, uint32_t max_phases);
+void decimator_filter_terminate(decimator_filter_t *filter);
+
+int decimator_init(decimator_t *decimator, const decimator_filter_t *filter);
+/* Starts over on a new signal, as if preceded by silence */
+void decimator_reset(decimator_t *decimator);
+/* Upper bound of the samples decimator_process produces from n inputs */
+size_t decimator_max_output(const decimator_t *decimator, size_t n);
+/* Returns the number of samples written to out */
+size_t decimator_process(decimator_t *decimator, const int16_t *in, size_t n,
+			 int16_t *out);
+void decimator_terminate(decimator_t *decimator);
+
+#endif
@@ -0,0 +1,146 @@
+#include "dot_product.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define DOT_PRODUCT_X86 1
+#elif defined(__arm__) || defined(__aarch64__)
+#include <sys/auxv.h>
+#if defined(__arm__)
+#include <asm/hwcap.h>
+#endif
+#define DOT_PRODUCT_ARM 1
+#endif
+
+#if DOT_PRODUCT_X86
+static uint64_t dot_product_sse2(const int16_t *x, const int16_t *y,
+				 size_t len);
+static uint64_t dot_product_avx2(const int16_t *x, const int16_t *y,
+				 size_t len);
+#endif
+
+static const dot_product_kernel_t kernels[] = {
+	{ .name = "scalar", .fn = dot_product_scalar },
+#if DOT_PRODUCT_X86
+	{ .name = "sse2", .fn = dot_product_sse2 },
+	{ .name = "avx2", .fn = dot_product_avx2 },
+#elif DOT_PRODUCT_ARM
+	{ .name = "neon", .fn = dot_product_neon },
+#endif
+};
+
+static size_t nb_supported_kernels = 1;
+static const dot_product_kernel_t *selected_kernel = &kernels[0];
+
+/*
+ * Kernels are ordered from slowest to fastest so the supported ones are
+ * always a prefix of the table
+ */
+__attribute__((constructor)) static void dot_product_select_kernel(void)
+{
+	nb_supported_kernels = 1;
+#if DOT_PRODUCT_X86
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("sse2")) {
+		nb_supported_kernels++;
+		if (__builtin_cpu_supports("avx2")) {
+			nb_supported_kernels++;
+		}
+	}
+#elif DOT_PRODUCT_ARM
+#if defined(__arm__)
+	if (getauxval(AT_HWCAP) & HWCAP_NEON) {
+		nb_supported_kernels++;
+	}
+#else
+	/* Advanced SIMD is mandatory on aarch64 */
+	nb_supported_kernels++;
+#endif
+#endif
+	selected_kernel = &kernels[nb_supported_kernels - 1];
+}
+
+uint64_t dot_product(const int16_t *x, const int16_t *y, size_t len)
+{
+	return selected_kernel->fn(x, y, len);
+}
+
+const char *dot_product_kernel_name(void)
+{
+	return selected_kernel->name;
+}
+
+size_t dot_product_get_kernels(const dot_product_kernel_t **supported)
+{
+	*supported = kernels;
+	return nb_supported_kernels;
+}
+
+uint64_t dot_product_scalar(const int16_t *x, const int16_t *y, size_t len)
+{
+	int64_t dot = 0;
+	for (size_t i = 0; i < len; ++i) {
+		dot += x[i] * y[i];
+	}
+	return dot >= 0 ? dot : -dot;
+}
+
+#if DOT_PRODUCT_X86
+static uint64_t dot_product_sse2(const int16_t *x, const int16_t *y,
+				 size_t len)
+{
+	__m128i acc = _mm_setzero_si128();
+	size_t i = 0;
+
+	for (; i + 8 <= len; i += 8) {
+		const __m128i a = _mm_loadu_si128((const __m128i *)(x + i));
+		const __m128i b = _mm_loadu_si128((const __m128i *)(y + i));
+		/* 4 x int32 sums of two adjacent products */
+		const __m128i prod = _mm_madd_epi16(a, b);
+		/* No pmovsxdq before SSE4.1, sign extend by hand */
+		const __m128i sign = _mm_srai_epi32(prod, 31);
+		acc = _mm_add_epi64(acc, _mm_unpacklo_epi32(prod, sign));
+		acc = _mm_add_epi64(acc, _mm_unpackhi_epi32(prod, sign));
+	}
+
+	int64_t lanes[2];
+	_mm_storeu_si128((__m128i *)lanes, acc);
+	int64_t dot = lanes[0] + lanes[1];
+
+	for (; i < len; ++i) {
+		dot += x[i] * y[i];
+	}
+	return dot >= 0 ? dot : -dot;
+}
+
+__attribute__((target("avx2"))) static uint64_t
+dot_product_avx2(const int16_t *x, const int16_t *y, size_t len)
+{
+	__m256i acc = _mm256_setzero_si256();
+	size_t i = 0;
+
+	for (; i + 16 <= len; i += 16) {
+		const __m256i a = _mm256_loadu_si256((const __m256i *)(x + i));
+		const __m256i b = _mm256_loadu_si256((const __m256i *)(y + i));
+		const __m256i prod = _mm256_madd_epi16(a, b);
+		acc = _mm256_add_epi64(
+			acc, _mm256_cvtepi32_epi64(
+				     _mm256_castsi256_si128(prod)));
+		acc = _mm256_add_epi64(
+			acc, _mm256_cvtepi32_epi64(
+				     _mm256_extracti128_si256(prod, 1)));
+	}
+
+	int64_t lanes[4];
+	_mm256_storeu_si256((__m256i *)lanes, acc);
+	int64_t dot = lanes[0] + lanes[1] + lanes[2] + lanes[3];
+
+	for (; i < len; ++i) {
+		dot += x[i] * y[i];
+	}
+	return dot >= 0 ? dot : -dot;
+}
+#endif
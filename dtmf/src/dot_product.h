@@ -0,0 +1,32 @@
+#ifndef DOT_PRODUCT_H
+#define DOT_PRODUCT_H
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * All kernels return |sum(x[i] * y[i])| and give the exact same result as
+ * the scalar reference as long as y doesn't contain INT16_MIN (the vector
+ * kernels add two products in 32 bits before widening, which can only
+ * overflow for (-32768 * -32768) * 2)
+ */
+typedef uint64_t (*dot_product_fn_t)(const int16_t *x, const int16_t *y,
+				     size_t len);
+
+typedef struct {
+	const char *name;
+	dot_product_fn_t fn;
+} dot_product_kernel_t;
+
+uint64_t dot_product(const int16_t *x, const int16_t *y, size_t len);
+uint64_t dot_product_scalar(const int16_t *x, const int16_t *y, size_t len);
+
+/* Name of the kernel picked for this CPU */
+const char *dot_product_kernel_name(void);
+/* Kernels that can run on this CPU, the scalar reference comes first */
+size_t dot_product_get_kernels(const dot_product_kernel_t **kernels);
+
+#if defined(__arm__) || defined(__aarch64__)
+uint64_t dot_product_neon(const int16_t *x, const int16_t *y, size_t len);
+#endif
+
+#endif
@@ -0,0 +1,31 @@
+#include "dot_product.h"
+
+#include <arm_neon.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Built with -mfpu=neon on 32 bits arm, only called when the CPU reports
+ * NEON support
+ */
+uint64_t dot_product_neon(const int16_t *x, const int16_t *y, size_t len)
+{
+	int64x2_t acc = vdupq_n_s64(0);
+	size_t i = 0;
+
+	for (; i + 8 <= len; i += 8) {
+		const int16x8_t a = vld1q_s16(x + i);
+		const int16x8_t b = vld1q_s16(y + i);
+		/* Two products per int32 lane, then widen to int64 */
+		int32x4_t prod = vmull_s16(vget_low_s16(a), vget_low_s16(b));
+		prod = vmlal_s16(prod, vget_high_s16(a), vget_high_s16(b));
+		acc = vpadalq_s32(acc, prod);
+	}
+
+	int64_t dot = vgetq_lane_s64(acc, 0) + vgetq_lane_s64(acc, 1);
+
+	for (; i < len; ++i) {
+		dot += x[i] * y[i];
+	}
+	return dot >= 0 ? dot : -dot;
+}
@@ -45,26 +45,44 @@ dtmf_button_t buttons[] = {
 };
 #endif
 
-dtmf_button_t *dtmf_get_button(char value)
+/* Indexed by byte value, filled from buttons[] before main runs */
+dtmf_char_t dtmf_chars[256];
+
+__attribute__((constructor)) static void build_char_table(void)
 {
 	for (size_t i = 0; i < ARRAY_LEN(buttons); ++i) {
-		if (strchr(buttons[i].characters, value) != NULL) {
-			return &buttons[i];
+		const char *characters = buttons[i].characters;
+		const size_t nb_characters = strlen(characters);
+		for (size_t j = 0; j < nb_characters; ++j) {
+			dtmf_chars[(unsigned char)characters[j]] = (dtmf_char_t){
+				.button_index = i,
+				.presses = j + 1,
+				.nb_characters = nb_characters,
+				/* The special button is never encoded */
+				.valid = characters[j] != SPECIAL_BUTTON_CHAR,
+			};
 		}
 	}
-	return NULL;
+}
+
+dtmf_button_t *dtmf_get_button(char value)
+{
+	const dtmf_char_t *c = dtmf_get_char(value);
+	/* presses is 0 for characters that aren't on any button */
+	if (c->presses == 0) {
+		return NULL;
+	}
+	return &buttons[c->button_index];
 }
 size_t dtmf_get_times_to_push(size_t btn_nr, char value, size_t extra_presses)
 {
 	assert(btn_nr < ARRAY_LEN(buttons));
 
-	const char *char_btn_position =
-		strchr(buttons[btn_nr].characters, value);
+	const dtmf_char_t *c = dtmf_get_char(value);
 
-	assert(char_btn_position);
+	assert(c->presses != 0 && c->button_index == btn_nr);
 
-	const size_t index = char_btn_position - buttons[btn_nr].characters + 1;
-	return index + (strlen(buttons[btn_nr].characters) * extra_presses);
+	return c->presses + (c->nb_characters * extra_presses);
 }
 
 char dtmf_decode_character(dtmf_button_t *button, size_t presses)
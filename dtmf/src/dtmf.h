@@ -21,12 +21,81 @@ typedef struct {
 	uint32_t channels;
 } dtmf_t;
 
+typedef enum {
+	DTMF_DECODE_FREQUENCY_DOMAIN,
+	/* Separate correlation of each row and column tone */
+	DTMF_DECODE_TIME_DOMAIN,
+	DTMF_DECODE_GOERTZEL,
+	/* Correlation with the full signal of each of the 12 buttons */
+	DTMF_DECODE_TIME_DOMAIN_COMBINED,
+	/* Tone energies tracked on every sample by a sliding dft */
+	DTMF_DECODE_SLIDING,
+} dtmf_decode_mode_t;
+
+/*
+ * Tables (reference signals, goertzel coefficients) and scratch needed to
+ * decode signals of one sample rate. The tables are built once and never
+ * written again, contexts made by dtmf_decoder_ctx_share use the same tables
+ * with their own scratch so each thread can decode with its own context.
+ * A context is used by one decode at a time. Signals faster than 8 kHz are
+ * decimated to 8 kHz before the analysis, sample_rate is the input rate.
+ */
+typedef struct dtmf_decoder_ctx dtmf_decoder_ctx_t;
+
+/* Streaming decoder, see dtmf_decoder_create */
+typedef struct dtmf_decoder dtmf_decoder_t;
+typedef void (*dtmf_decoder_char_cb_t)(char c, void *user_data);
+
 bool dtmf_is_valid(const char *value);
 
 dtmf_err_t dtmf_encode(dtmf_t *dtmf, const char *value);
-char *dtmf_decode(dtmf_t *dtmf);
-char *dtmf_decode_time_domain(dtmf_t *dtmf);
-char *dtmf_decode_fpga(dtmf_t *dtmf);
+/* Number of samples dtmf_encode produces for a valid value */
+size_t dtmf_encoded_length(const char *value);
+
+dtmf_decoder_ctx_t *dtmf_decoder_ctx_create(uint32_t sample_rate);
+dtmf_decoder_ctx_t *dtmf_decoder_ctx_share(dtmf_decoder_ctx_t *ctx);
+uint32_t dtmf_decoder_ctx_sample_rate(const dtmf_decoder_ctx_t *ctx);
+void dtmf_decoder_ctx_terminate(dtmf_decoder_ctx_t *ctx);
+
+char *dtmf_decode(dtmf_decoder_ctx_t *ctx, dtmf_t *dtmf);
+char *dtmf_decode_time_domain(dtmf_decoder_ctx_t *ctx, dtmf_t *dtmf);
+char *dtmf_decode_time_domain_combined(dtmf_decoder_ctx_t *ctx, dtmf_t *dtmf);
+char *dtmf_decode_goertzel(dtmf_decoder_ctx_t *ctx, dtmf_t *dtmf);
+/*
+ * Presses and releases found with sample accuracy instead of on fixed
+ * strides, the character boundaries come from the measured pauses
+ */
+char *dtmf_decode_sliding(dtmf_decoder_ctx_t *ctx, dtmf_t *dtmf);
+/*
+ * Decodes each channel of an interleaved signal on its own, in a single pass
+ * over the frames, with the detection of DTMF_DECODE_SLIDING. Returns
+ * dtmf->channels strings, the value of channel i at index i. The strings and
+ * the array are freed with free(). The other decoders only take mono signals.
+ */
+char **dtmf_decode_channels(dtmf_decoder_ctx_t *ctx, dtmf_t *dtmf);
+char *dtmf_decode_fpga(dtmf_decoder_ctx_t *ctx, dtmf_t *dtmf);
+/* Row and column reference layout, 14 correlations per window instead of 12 */
+char *dtmf_decode_fpga_separable(dtmf_decoder_ctx_t *ctx, dtmf_t *dtmf);
+/* Same result as the serial decoders, classification runs on nb_threads */
+char *dtmf_decode_parallel(dtmf_decoder_ctx_t *ctx, dtmf_t *dtmf,
+			   dtmf_decode_mode_t mode, size_t nb_threads);
+
+/*
+ * Decodes a signal fed in chunks of any size. on_char is called as soon as a
+ * silence confirms a character. Only about one window of samples is kept.
+ * The samples are mono. The decoder uses ctx until it is terminated.
+ */
+dtmf_decoder_t *dtmf_decoder_create(dtmf_decoder_ctx_t *ctx,
+				    dtmf_decode_mode_t mode,
+				    dtmf_decoder_char_cb_t on_char,
+				    void *user_data);
+int dtmf_decoder_feed(dtmf_decoder_t *decoder, const int16_t *samples,
+		      size_t n);
+/* Starts over on a new stream, keeping the allocated scratch */
+void dtmf_decoder_reset(dtmf_decoder_t *decoder);
+/* Signals the end of the stream, emits the last character if any */
+void dtmf_decoder_finish(dtmf_decoder_t *decoder);
+void dtmf_decoder_terminate(dtmf_decoder_t *decoder);
 
 const char *dtmf_err_to_string(dtmf_err_t err);
 void dtmf_terminate(dtmf_t *dtmf);
@@ -2,11 +2,19 @@
 #include "dtmf_private.h"
 
 #include "buffer.h"
+#include "decimator.h"
+#include "dot_product.h"
+#include "envelope.h"
 #include "fpga.h"
 #include "utils.h"
 #include "fft.h"
+#include "goertzel.h"
+#include "sliding_dft.h"
 #include "window.h"
 #include <assert.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdatomic.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
@@ -15,42 +23,334 @@
 #include <string.h>
 
 #define RESULT_BUFFER_INITIAL_LEN 128
+/*
+ * Faster signals are decimated to this rate first, every DTMF tone is below
+ * 1.7 kHz. Rates needing more polyphase components are analysed as they are
+ */
+#define ANALYSIS_SAMPLE_RATE	  8000
+#define DECIMATOR_MAX_PHASES	  512
+/* Input frames the streaming decoders decimate at once */
+#define STREAM_DECIMATE_CHUNK	  1024
 #define MIN_FREQ		  650
 #define MAX_FREQ		  1500
+/*
+ * Minimum share of the window energy that must be held by the strongest row
+ * and column tones for the goertzel decoder to accept the window
+ */
+#define GOERTZEL_MIN_TONE_RATIO	  0.5
+/* Windows a worker takes from the shared queue at once */
+#define PARALLEL_CHUNK_WINDOWS	  16
+/* Bounds the work thrown away when a window doesn't decode */
+#define SEGMENT_MAX_WINDOWS	  512
+/* Sliding dft window, the usual 205 samples of the DTMF goertzel at 8 kHz */
+#define SLIDING_WINDOW_SAMPLES(sample_rate) ((sample_rate) * 205 / 8000)
+/* A tone or a silence must hold this long to change the tracked state */
+#define SLIDING_DEBOUNCE_DURATION 0.005
+/* Pauses longer than this end a character, shorter ones separate presses */
+#define SLIDING_CHAR_PAUSE_DURATION \
+	((SAME_CHAR_PAUSE_DURATION + CHAR_PAUSE_DURATION) / 2)
+/* Windows with a lower RMS amplitude are silent */
+#define SLIDING_MIN_RMS 64
 
-typedef dtmf_button_t *(*dtmf_decode_button_cb_t)(const int16_t *signal,
-						  cplx_t *buffer, size_t len,
-						  uint32_t sample_rate);
+static const uint16_t ROW_FREQUENCIES[] = { 697, 770, 852, 941 };
+static const uint16_t COL_FREQUENCIES[] = { 1209, 1336, 1477 };
+/* 
+ * The fourth column (A, B, C, D) isn't used by the encoder but evaluating it
+ * lets the goertzel decoder reject those tones instead of mapping them to
+ * the closest button
+ */
+static const uint16_t GOERTZEL_COL_FREQUENCIES[] = { 1209, 1336, 1477, 1633 };
+
+#define NB_BUTTONS ARRAY_LEN(ROW_FREQUENCIES) * ARRAY_LEN(COL_FREQUENCIES)
+#define NB_TONES   (ARRAY_LEN(ROW_FREQUENCIES) + ARRAY_LEN(COL_FREQUENCIES))
+/* In phase and quadrature reference per tone */
+#define NB_TONE_REFERENCES (2 * NB_TONES)
+/* Leaves room for the vector dot products, see dot_product.h */
+#define TONE_REFERENCE_AMPLITUDE 16384
+
+/* Reusable real fft plan and the len / 2 + 1 bins it produces */
+typedef struct {
+	rfft_plan_t plan;
+	cplx_t *buffer;
+	/* Spectra of FFT_BATCH windows, for the classification of a list */
+	fft_batch_t batch;
+} fft_scratch_t;
+
+/*
+ * Everything derived from the sample rate alone. Read only once built so any
+ * number of threads can use it, freed with the last context referencing it
+ */
+typedef struct {
+	atomic_size_t refs;
+	uint32_t input_rate; /* Rate of the signals given to the decoder */
+	bool decimate;
+	decimator_filter_t filter; /* input_rate to sample_rate */
+	uint32_t sample_rate; /* Rate of the analysis */
+	size_t len; /* Window length, power of 2 */
+	/* Used for time domain decoding in order to correlate */
+	size_t reference_len;
+	/* NB_BUTTONS * reference_len, row + column tone of each button */
+	int16_t *references;
+	/*
+	 * NB_TONE_REFERENCES * reference_len, rows then columns, the in phase
+	 * reference of each tone followed by its quadrature
+	 */
+	int16_t *tone_references;
+	float row_coeffs[ARRAY_LEN(ROW_FREQUENCIES)];
+	float col_coeffs[ARRAY_LEN(GOERTZEL_COL_FREQUENCIES)];
+} decoder_tables_t;
+
+struct dtmf_decoder_ctx {
+	decoder_tables_t *tables;
+	fft_scratch_t scratch;
+	/* window_t list, reused from one decode to the next */
+	buffer_t windows;
+	/* Min / max index of the signal being decoded */
+	envelope_t envelope;
+	/* Decimated signal being decoded, when the tables decimate */
+	decimator_t decimator;
+	buffer_t decimated;
+};
 
-static dtmf_button_t *decode_button_frequency_domain(const int16_t *signal,
-						     cplx_t *buffer, size_t len,
-						     uint32_t sample_rate);
+typedef dtmf_button_t *(*dtmf_decode_button_cb_t)(
+	const int16_t *signal, const decoder_tables_t *tables,
+	fft_scratch_t *scratch);
+
+static dtmf_button_t *
+decode_button_frequency_domain(const int16_t *signal,
+			       const decoder_tables_t *tables,
+			       fft_scratch_t *scratch);
+static dtmf_button_t *button_from_frequencies(uint32_t f1, uint32_t f2);
 
 static dtmf_button_t *decode_button_time_domain(const int16_t *signal,
-						cplx_t *buffer, size_t len,
-						uint32_t sample_rate);
+						const decoder_tables_t *tables,
+						fft_scratch_t *scratch);
 
-/* Used for time domain decoding in order to correlate */
-static int16_t *button_reference_signals = NULL;
-static bool generated_references = false;
+static dtmf_button_t *
+decode_button_time_domain_combined(const int16_t *signal,
+				   const decoder_tables_t *tables,
+				   fft_scratch_t *scratch);
+static dtmf_button_t *classify_tones(const uint64_t *dots);
 
-static void generate_reference_signals(size_t len, uint32_t sample_rate);
-static const uint16_t ROW_FREQUENCIES[] = { 697, 770, 852, 941 };
-static const uint16_t COL_FREQUENCIES[] = { 1209, 1336, 1477 };
+static dtmf_button_t *decode_button_goertzel(const int16_t *signal,
+					     const decoder_tables_t *tables,
+					     fft_scratch_t *scratch);
 
-#define NB_BUTTONS ARRAY_LEN(ROW_FREQUENCIES) * ARRAY_LEN(COL_FREQUENCIES)
+static decoder_tables_t *decoder_tables_create(uint32_t sample_rate);
+static void decoder_tables_release(decoder_tables_t *tables);
+static dtmf_decoder_ctx_t *context_create(decoder_tables_t *tables);
+static int check_sample_rate(const dtmf_decoder_ctx_t *ctx,
+			     const dtmf_t *dtmf);
+static int check_mono_signal(const dtmf_decoder_ctx_t *ctx,
+			     const dtmf_t *dtmf);
+static int analysis_signal(dtmf_decoder_ctx_t *ctx, const dtmf_t *dtmf,
+			   dtmf_t *signal);
 
-static int16_t get_max_amplitude(const int16_t *buffer, size_t len);
+static void get_amplitude_range(const int16_t *buffer, size_t len,
+				int16_t *min, int16_t *max);
 static bool is_silence(const int16_t *buffer, size_t len, int16_t target);
+static bool envelope_is_silence(const envelope_t *envelope, size_t start,
+				size_t len, int16_t target);
 static bool is_valid_frequency(uint32_t freq);
 static int push_decoded(dtmf_button_t *btn, buffer_t *result, size_t *presses);
-static ssize_t find_start_of_file(dtmf_t *dtmf, cplx_t *buffer, size_t len,
-				  int16_t *amplitude);
+static ssize_t find_start_of_file(dtmf_t *dtmf,
+				  dtmf_decode_button_cb_t detect_button_fn,
+				  const decoder_tables_t *tables,
+				  const envelope_t *envelope,
+				  fft_scratch_t *scratch, int16_t *amplitude);
+
+typedef void (*sliding_char_cb_t)(size_t channel, char c, void *user_data);
+
+typedef struct {
+	dtmf_button_t *candidate; /* Detection on the current window */
+	size_t candidate_since;
+	dtmf_button_t *pressed; /* Debounced state, NULL when silent */
+	size_t released_at;
+	dtmf_button_t *btn; /* Button of the character being typed */
+	size_t presses;
+} sliding_channel_t;
+
+/*
+ * Per sample tone tracking of DTMF_DECODE_SLIDING. A press starts once the
+ * same button was detected for the debounce duration and ends the same way
+ * on silence, so the onsets and releases are known to the sample.
+ * Every channel of an interleaved signal is tracked in the same pass, the
+ * detection runs on all of them at once.
+ */
+typedef struct {
+	sliding_dft_t sdft; /* Rows then the 4 columns */
+	size_t nb_channels;
+	size_t debounce;
+	size_t char_pause;
+	int64_t min_energy;
+	size_t now; /* Frames fed so far */
+	sliding_channel_t *channels;
+	/* Per channel scratch of sliding_classify */
+	double *powers;
+	double *row_power;
+	double *col_power;
+	uint8_t *row;
+	uint8_t *col;
+	dtmf_button_t **detected;
+	sliding_char_cb_t on_char;
+	void *user_data;
+} sliding_tracker_t;
+
+typedef enum {
+	DECODER_PHASE_FIND_START,
+	DECODER_PHASE_DECODE,
+	DECODER_PHASE_FAILED,
+} decoder_phase_t;
 
-static char *dtmf_decode_internal(dtmf_t *dtmf,
-				  dtmf_decode_button_cb_t decode_button_fn);
+/*
+ * Decoding state shared by the batch decoders and the streaming API.
+ * Positions are absolute sample indexes since the start of the signal
+ */
+struct dtmf_decoder {
+	uint32_t sample_rate;
+	size_t len;
+	size_t samples_to_skip_on_silence;
+	size_t samples_to_skip_on_press;
+	dtmf_decode_button_cb_t detect_button_fn;
+	dtmf_decode_button_cb_t decode_button_fn;
+	const decoder_tables_t *tables;
+	/* Borrowed from the context */
+	fft_scratch_t *scratch;
+	dtmf_decoder_char_cb_t on_char;
+	void *user_data;
 
-static char *dtmf_decode_internal_fpga(dtmf_t *dtmf);
+	decoder_phase_t phase;
+	size_t next_window;
+	int16_t target_amplitude;
+	dtmf_button_t *btn;
+	size_t consecutive_presses;
+
+	/* Streaming only: ring of the samples from next_window onwards */
+	int16_t *history;
+	size_t history_capacity; /* Power of 2 */
+	size_t history_head; /* Ring index of history_start */
+	size_t history_start;
+	size_t history_len;
+	/* Contiguous copy of a window that wraps around the ring */
+	int16_t *window;
+
+	/* DTMF_DECODE_SLIDING only, replaces the windows */
+	sliding_tracker_t *sliding;
+
+	/* Streaming only, when the context decimates */
+	decimator_t decimator;
+	int16_t *decimated; /* Output of STREAM_DECIMATE_CHUNK samples */
+};
+
+static char *dtmf_decode_internal(dtmf_decoder_ctx_t *ctx, dtmf_t *dtmf,
+				  dtmf_decode_button_cb_t detect_button_fn,
+				  dtmf_decode_button_cb_t decode_button_fn,
+				  size_t nb_threads);
+static int decoder_init(dtmf_decoder_t *decoder, dtmf_decoder_ctx_t *ctx,
+			dtmf_decode_button_cb_t detect_button_fn,
+			dtmf_decode_button_cb_t decode_button_fn,
+			dtmf_decoder_char_cb_t on_char, void *user_data,
+			bool with_history);
+static void decoder_terminate(dtmf_decoder_t *decoder);
+static int decoder_feed(dtmf_decoder_t *decoder, const int16_t *samples,
+			size_t n);
+static int decoder_process_window(dtmf_decoder_t *decoder,
+				  const int16_t *window);
+static void decoder_find_start(dtmf_decoder_t *decoder, const int16_t *window,
+			       int16_t max);
+static int decoder_advance(dtmf_decoder_t *decoder, bool silence,
+			   dtmf_button_t *new_btn);
+static void decoder_emit(dtmf_decoder_t *decoder);
+static void decoder_flush(dtmf_decoder_t *decoder);
+static const int16_t *history_window(dtmf_decoder_t *decoder);
+static void history_discard(dtmf_decoder_t *decoder);
+static void push_result(char c, void *user_data);
+
+static sliding_tracker_t *sliding_tracker_create(uint32_t sample_rate,
+						 size_t nb_channels,
+						 sliding_char_cb_t on_char,
+						 void *user_data);
+static void sliding_tracker_reset(sliding_tracker_t *tracker);
+static void sliding_tracker_terminate(sliding_tracker_t *tracker);
+static void sliding_feed(sliding_tracker_t *tracker, const int16_t *frames,
+			 size_t nb_frames);
+static void sliding_flush(sliding_tracker_t *tracker);
+static void sliding_classify(sliding_tracker_t *tracker);
+static void sliding_update(sliding_tracker_t *tracker, size_t channel,
+			   dtmf_button_t *btn);
+static void sliding_change_state(sliding_tracker_t *tracker, size_t channel);
+static void sliding_emit(sliding_tracker_t *tracker, size_t channel);
+static void sliding_emit_decoder(size_t channel, char c, void *user_data);
+static void push_channel_result(size_t channel, char c, void *user_data);
+static size_t decimate_frames(decimator_t *decimators, size_t nb_channels,
+			      const int16_t *frames, size_t nb_frames,
+			      int16_t *scratch_in, int16_t *scratch_out,
+			      int16_t *out);
+static int channels_feed(const decoder_tables_t *tables, const dtmf_t *dtmf,
+			 sliding_tracker_t *tracker);
+
+typedef struct {
+	const dtmf_decoder_t *decoder;
+	const int16_t *signal;
+	window_t *windows;
+	size_t nb_windows;
+	atomic_size_t next;
+} classify_job_t;
+
+typedef struct classify_pool classify_pool_t;
+
+typedef struct {
+	pthread_t thread;
+	classify_pool_t *pool;
+	fft_scratch_t scratch;
+} classify_worker_t;
+
+/*
+ * Workers started once per decode. Every segmentation round publishes a job
+ * and wakes them, the last one to run out of windows wakes the caller
+ */
+struct classify_pool {
+	classify_worker_t *workers;
+	size_t nb_workers;
+	pthread_mutex_t lock;
+	pthread_cond_t job_ready;
+	pthread_cond_t job_done;
+	/* Bumped by every job, each worker runs a generation once */
+	size_t generation;
+	size_t nb_running;
+	bool stop;
+	classify_job_t job;
+};
+
+static int segment_windows(const dtmf_decoder_t *decoder,
+			   const envelope_t *envelope, buffer_t *windows,
+			   size_t *leading_silences);
+static classify_pool_t *classify_pool_create(const dtmf_decoder_t *decoder,
+					     size_t nb_threads);
+static void classify_pool_destroy(classify_pool_t *pool);
+static void classify_windows(const dtmf_decoder_t *decoder,
+			     classify_pool_t *pool, const int16_t *signal,
+			     buffer_t *windows);
+static void classify_range(const dtmf_decoder_t *decoder,
+			   const int16_t *signal, window_t *windows,
+			   size_t start, size_t end, fft_scratch_t *scratch);
+static void classify_range_frequency_domain(const decoder_tables_t *tables,
+					    const int16_t *signal,
+					    window_t *windows, size_t start,
+					    size_t end, fft_scratch_t *scratch);
+static void *classify_worker(void *arg);
+static int replay_windows(dtmf_decoder_t *decoder, const buffer_t *windows,
+			  size_t leading_silences);
+
+static char *dtmf_decode_internal_fpga(dtmf_decoder_ctx_t *ctx,
+					dtmf_t *dtmf, bool separable);
+static int fpga_classify_tones(fpga_t *fpga, dtmf_t *dtmf,
+			       const decoder_tables_t *tables,
+			       buffer_t *windows);
+
+static int fft_scratch_init(fft_scratch_t *scratch, size_t len);
+static void fft_scratch_terminate(fft_scratch_t *scratch);
+static fft_scratch_t *context_fft_scratch(dtmf_decoder_ctx_t *ctx);
 
 static inline size_t decode_samples_to_skip_on_silence(uint32_t sample_rate)
 {
@@ -76,45 +376,186 @@ const char *dtmf_err_to_string(dtmf_err_t err)
 	return "dtmf unknown error";
 }
 
-char *dtmf_decode_time_domain(dtmf_t *dtmf)
+dtmf_decoder_ctx_t *dtmf_decoder_ctx_create(uint32_t sample_rate)
+{
+	decoder_tables_t *tables = decoder_tables_create(sample_rate);
+	if (!tables) {
+		return NULL;
+	}
+	dtmf_decoder_ctx_t *ctx = context_create(tables);
+	/* The context holds its own reference */
+	decoder_tables_release(tables);
+	return ctx;
+}
+
+dtmf_decoder_ctx_t *dtmf_decoder_ctx_share(dtmf_decoder_ctx_t *ctx)
+{
+	return context_create(ctx->tables);
+}
+
+uint32_t dtmf_decoder_ctx_sample_rate(const dtmf_decoder_ctx_t *ctx)
+{
+	return ctx->tables->input_rate;
+}
+
+const int16_t *dtmf_decoder_ctx_references(const dtmf_decoder_ctx_t *ctx,
+					   size_t *nb_references,
+					   size_t *reference_len)
+{
+	*nb_references = NB_BUTTONS;
+	*reference_len = ctx->tables->reference_len;
+	return ctx->tables->references;
+}
+
+void dtmf_decoder_ctx_terminate(dtmf_decoder_ctx_t *ctx)
+{
+	if (!ctx) {
+		return;
+	}
+	decoder_tables_release(ctx->tables);
+	fft_scratch_terminate(&ctx->scratch);
+	buffer_terminate(&ctx->windows);
+	envelope_terminate(&ctx->envelope);
+	decimator_terminate(&ctx->decimator);
+	buffer_terminate(&ctx->decimated);
+	free(ctx);
+}
+
+char *dtmf_decode_time_domain(dtmf_decoder_ctx_t *ctx, dtmf_t *dtmf)
+{
+	return dtmf_decode_internal(ctx, dtmf, decode_button_frequency_domain,
+				    decode_button_time_domain, 1);
+}
+
+char *dtmf_decode_time_domain_combined(dtmf_decoder_ctx_t *ctx, dtmf_t *dtmf)
+{
+	return dtmf_decode_internal(ctx, dtmf, decode_button_frequency_domain,
+				    decode_button_time_domain_combined, 1);
+}
+
+char *dtmf_decode(dtmf_decoder_ctx_t *ctx, dtmf_t *dtmf)
+{
+	return dtmf_decode_internal(ctx, dtmf, decode_button_frequency_domain,
+				    decode_button_frequency_domain, 1);
+}
+
+char *dtmf_decode_goertzel(dtmf_decoder_ctx_t *ctx, dtmf_t *dtmf)
+{
+	return dtmf_decode_internal(ctx, dtmf, decode_button_goertzel,
+				    decode_button_goertzel, 1);
+}
+
+/* Whole signal through the streaming decoder, the tracking is per sample */
+char *dtmf_decode_sliding(dtmf_decoder_ctx_t *ctx, dtmf_t *dtmf)
+{
+	if (check_mono_signal(ctx, dtmf) < 0) {
+		return NULL;
+	}
+	buffer_t result;
+	if (buffer_init(&result, RESULT_BUFFER_INITIAL_LEN, sizeof(char)) < 0) {
+		printf("Failed to allocate memory for decode result\n");
+		return NULL;
+	}
+	dtmf_decoder_t *decoder = dtmf_decoder_create(ctx, DTMF_DECODE_SLIDING,
+						      push_result, &result);
+	if (!decoder) {
+		printf("Failed to allocate memory for decode\n");
+		buffer_terminate(&result);
+		return NULL;
+	}
+	dtmf_decoder_feed(decoder, dtmf->buffer.data, dtmf->buffer.len);
+	dtmf_decoder_finish(decoder);
+	dtmf_decoder_terminate(decoder);
+
+	buffer_push_char(&result, '\0');
+	return (char *)result.data;
+}
+
+char **dtmf_decode_channels(dtmf_decoder_ctx_t *ctx, dtmf_t *dtmf)
 {
-	return dtmf_decode_internal(dtmf, decode_button_time_domain);
+	if (check_sample_rate(ctx, dtmf) < 0) {
+		return NULL;
+	}
+	const size_t nb_channels = dtmf->channels;
+	if (nb_channels == 0) {
+		printf("Signal without any channel\n");
+		return NULL;
+	}
+	char **values = malloc(nb_channels * sizeof(*values));
+	buffer_t *results = calloc(nb_channels, sizeof(*results));
+	bool allocated = values && results;
+	for (size_t c = 0; allocated && c < nb_channels; ++c) {
+		allocated = buffer_init(&results[c], RESULT_BUFFER_INITIAL_LEN,
+					sizeof(char)) == 0;
+	}
+	sliding_tracker_t *tracker =
+		allocated ? sliding_tracker_create(ctx->tables->sample_rate,
+						   nb_channels,
+						   push_channel_result, results) :
+			    NULL;
+	if (!tracker || channels_feed(ctx->tables, dtmf, tracker) < 0) {
+		printf("Failed to allocate memory for decode\n");
+		sliding_tracker_terminate(tracker);
+		for (size_t c = 0; results && c < nb_channels; ++c) {
+			buffer_terminate(&results[c]);
+		}
+		free(results);
+		free(values);
+		return NULL;
+	}
+	sliding_flush(tracker);
+	sliding_tracker_terminate(tracker);
+
+	for (size_t c = 0; c < nb_channels; ++c) {
+		buffer_push_char(&results[c], '\0');
+		values[c] = (char *)results[c].data;
+	}
+	free(results);
+	return values;
 }
 
-char *dtmf_decode(dtmf_t *dtmf)
+char *dtmf_decode_fpga(dtmf_decoder_ctx_t *ctx, dtmf_t *dtmf)
 {
-	return dtmf_decode_internal(dtmf, decode_button_frequency_domain);
+	return dtmf_decode_internal_fpga(ctx, dtmf, false);
 }
 
-char *dtmf_decode_fpga(dtmf_t *dtmf)
+char *dtmf_decode_fpga_separable(dtmf_decoder_ctx_t *ctx, dtmf_t *dtmf)
 {
-	return dtmf_decode_internal_fpga(dtmf);
+	return dtmf_decode_internal_fpga(ctx, dtmf, true);
 }
 
-static char *dtmf_decode_internal_fpga(dtmf_t *dtmf)
+static char *dtmf_decode_internal_fpga(dtmf_decoder_ctx_t *ctx, dtmf_t *dtmf,
+				       bool separable)
 {
+	/* The correlator windows only fit at the analysis rate */
+	dtmf_t analysed;
+	if (analysis_signal(ctx, dtmf, &analysed) < 0) {
+		return NULL;
+	}
+	dtmf = &analysed;
+	const decoder_tables_t *tables = ctx->tables;
 	const size_t samples_to_skip_on_silence =
 		decode_samples_to_skip_on_silence(dtmf->sample_rate);
 	const size_t samples_to_skip_on_press =
 		decode_samples_to_skip_on_press(dtmf->sample_rate);
-	const size_t min_len = SAME_CHAR_PAUSE_SAMPLES(dtmf->sample_rate);
+	const size_t len = tables->len;
 
-	const size_t len =
-		is_power_of_2(min_len) ? min_len : align_to_power_of_2(min_len);
-
-	int16_t target_amplitude = 0;
-	ssize_t start = 0;
-	{
-		cplx_t *buffer = calloc(len, sizeof(*buffer));
-		if (!buffer) {
-			printf("Failed to allocate memory for decode\n");
-			return NULL;
-		}
+	const envelope_t *envelope = &ctx->envelope;
+	if (envelope_build(&ctx->envelope, dtmf->buffer.data,
+			   dtmf->buffer.len) < 0) {
+		printf("Failed to allocate memory for the signal envelope\n");
+		return NULL;
+	}
 
-		start = find_start_of_file(dtmf, buffer, len,
-					   &target_amplitude);
-		free(buffer);
+	fft_scratch_t *scratch = context_fft_scratch(ctx);
+	if (!scratch) {
+		printf("Failed to allocate memory for decode\n");
+		return NULL;
 	}
+	int16_t target_amplitude = 0;
+	const ssize_t start = find_start_of_file(
+		dtmf, decode_button_frequency_domain, tables, envelope,
+		scratch, &target_amplitude);
 
 	if (start < 0) {
 		printf("Couldn't find the first button press\n");
@@ -126,327 +567,1557 @@ static char *dtmf_decode_internal_fpga(dtmf_t *dtmf)
 	}
 
 	size_t i = (size_t)start;
-	const size_t window_nsamples =
-		5 * (dtmf->sample_rate / ROW_FREQUENCIES[0]);
 
 	/* Windows */
-	buffer_t windows;
-	int ret = buffer_init(&windows, RESULT_BUFFER_INITIAL_LEN,
-			      sizeof(window_t));
-	if (ret < 0) {
-		printf("Failed to allocate memory for decode result\n");
-		return NULL;
-	}
+	buffer_t *windows = &ctx->windows;
+	windows->len = 0;
 
 	/* FPGA */
 	fpga_t fpga;
-	ret = fpga_init(&fpga, window_nsamples);
+	int ret = fpga_init(&fpga, tables->reference_len);
 	if (ret < 0) {
-		buffer_terminate(&windows);
 		printf("Failed to connect to FPGA\n");
 		return NULL;
 	}
-	/* Reference signals  */
-	generate_reference_signals(window_nsamples, dtmf->sample_rate);
 
 	/* Generate windows*/
 	while ((i + len) < dtmf->buffer.len) {
 		/* First check for silence */
-		if (is_silence((int16_t *)dtmf->buffer.data + i, len,
-			       target_amplitude)) {
-			assert(windows.len != 0);
+		if (envelope_is_silence(envelope, i, len, target_amplitude)) {
+			assert(windows->len != 0);
 			window_t *window =
-				&((window_t *)windows.data)[windows.len - 1];
-			window->silence_detected_after = true;
+				&((window_t *)windows->data)[windows->len - 1];
+			window->silences_after++;
 
 			i += samples_to_skip_on_silence;
 			continue;
 		}
 		window_t window = { .data_offset = i,
-				    .button_index = 0xff,
-				    .silence_detected_after = false };
+				    .button_index = WINDOW_NO_BUTTON,
+				    .silences_after = 0 };
 
-		buffer_push(&windows, &window);
+		buffer_push_window(windows, window);
 		i += samples_to_skip_on_press;
 	}
 
-	ret = fpga_calculate_windows(&fpga, &windows, dtmf->buffer.data,
-				     button_reference_signals, NB_BUTTONS);
+	if (separable) {
+		ret = fpga_classify_tones(&fpga, dtmf, tables, windows);
+	} else {
+		ret = fpga_calculate_windows(&fpga, windows, dtmf->buffer.data,
+					     dtmf->buffer.len,
+					     tables->references, NB_BUTTONS);
+	}
+	fpga_terminate(&fpga);
 	if (ret) {
 		printf("Failed to calculate windows\n");
 		return NULL;
 	}
 
+	return dtmf_decode_fpga_windows(windows);
+}
+
+char *dtmf_decode_fpga_windows(const buffer_t *windows)
+{
 	size_t consecutive_presses = 0;
 	dtmf_button_t *curr_btn = NULL;
 	buffer_t result;
-	ret = buffer_init(&result, RESULT_BUFFER_INITIAL_LEN, sizeof(char));
-	for (size_t i = 0; i < windows.len; ++i) {
-		window_t *window = &((window_t *)windows.data)[i];
-		curr_btn = dtmf_get_button_by_index(window->button_index);
+	int ret = buffer_init(&result, RESULT_BUFFER_INITIAL_LEN, sizeof(char));
+	if (ret < 0) {
+		printf("Failed to allocate memory for decode result\n");
+		return NULL;
+	}
+	for (size_t i = 0; i < windows->len; ++i) {
+		const window_t *window = &((const window_t *)windows->data)[i];
+		/* A window no reference matches is noise, the press goes on */
+		if (window->button_index != WINDOW_NO_BUTTON) {
+			curr_btn =
+				dtmf_get_button_by_index(window->button_index);
+		}
+		if (!curr_btn) {
+			continue;
+		}
 
 		consecutive_presses++;
-		if (window->silence_detected_after || i + 1 == windows.len) {
+		if (window->silences_after || i + 1 == windows->len) {
 			push_decoded(curr_btn, &result, &consecutive_presses);
 		}
 	}
-	const char terminator = '\0';
-	buffer_push(&result, &terminator);
+	buffer_push_char(&result, '\0');
 	return (char *)result.data;
 }
 
-static char *dtmf_decode_internal(dtmf_t *dtmf,
-				  dtmf_decode_button_cb_t decode_button_fn)
+/* Same as the time domain decoder with the correlations done by the FPGA */
+static int fpga_classify_tones(fpga_t *fpga, dtmf_t *dtmf,
+			       const decoder_tables_t *tables,
+			       buffer_t *windows)
 {
-	const size_t samples_to_skip_on_silence =
-		decode_samples_to_skip_on_silence(dtmf->sample_rate);
-	const size_t samples_to_skip_on_press =
-		decode_samples_to_skip_on_press(dtmf->sample_rate);
-	const size_t min_len = SAME_CHAR_PAUSE_SAMPLES(dtmf->sample_rate);
+	int ret = fpga_set_signals(fpga, dtmf->buffer.data,
+				   tables->tone_references, NB_TONE_REFERENCES);
+	if (ret < 0) {
+		return ret;
+	}
 
-	const size_t len =
-		is_power_of_2(min_len) ? min_len : align_to_power_of_2(min_len);
+	window_t *window = windows->data;
+	uint64_t dots[NB_TONE_REFERENCES];
+	if (windows->len > 0) {
+		ret = fpga_set_window(fpga, window[0].data_offset);
+		if (ret) {
+			return ret;
+		}
+	}
+	/* Each window is set while the previous one is correlated */
+	for (size_t i = 0; i < windows->len; ++i) {
+		const size_t next = i + 1 < windows->len ?
+					    window[i + 1].data_offset :
+					    FPGA_NO_WINDOW;
+		ret = fpga_correlate(fpga, next, NB_TONE_REFERENCES, dots);
+		if (ret) {
+			return ret;
+		}
+		const dtmf_button_t *btn = classify_tones(dots);
+		window[i].button_index = btn ? btn->index : WINDOW_NO_BUTTON;
+	}
+	return 0;
+}
 
-	cplx_t *buffer = calloc(len, sizeof(*buffer));
-	if (!buffer) {
-		printf("Failed to allocate memory for decode\n");
+/*
+ * Decodes in two phases, like the FPGA decoder. The cheap silence check alone
+ * segments the signal into the list of windows to classify, assuming every
+ * non silent window decodes to a button. The windows are then classified in
+ * one sweep (on nb_threads) and replayed in order through the state machine.
+ * If a window doesn't decode, the state machine jumps somewhere else than
+ * predicted, so the segmentation restarts from there. The output is the same
+ * as feeding the windows one by one to decoder_process_window.
+ */
+static char *dtmf_decode_internal(dtmf_decoder_ctx_t *ctx, dtmf_t *dtmf,
+				  dtmf_decode_button_cb_t detect_button_fn,
+				  dtmf_decode_button_cb_t decode_button_fn,
+				  size_t nb_threads)
+{
+	dtmf_t analysed;
+	if (analysis_signal(ctx, dtmf, &analysed) < 0) {
 		return NULL;
 	}
+	dtmf = &analysed;
 	buffer_t result;
 	int ret = buffer_init(&result, RESULT_BUFFER_INITIAL_LEN, sizeof(char));
 	if (ret < 0) {
 		printf("Failed to allocate memory for decode result\n");
-		free(buffer);
 		return NULL;
 	}
-	int16_t target_amplitude = 0;
 
-	ssize_t start =
-		find_start_of_file(dtmf, buffer, len, &target_amplitude);
-	if (start < 0) {
-		printf("Couldn't find the first button press\n");
-		free(buffer);
+	/* The whole signal is available, no need for a history */
+	const int16_t *signal = dtmf->buffer.data;
+	const envelope_t *envelope = &ctx->envelope;
+	if (envelope_build(&ctx->envelope, signal, dtmf->buffer.len) < 0) {
+		printf("Failed to allocate memory for the signal envelope\n");
 		buffer_terminate(&result);
 		return NULL;
 	}
+	buffer_t *windows = &ctx->windows;
+	dtmf_decoder_t decoder;
+	ret = decoder_init(&decoder, ctx, detect_button_fn, decode_button_fn,
+			   push_result, &result, false);
+	if (ret < 0) {
+		printf("Failed to allocate memory for decode\n");
+		buffer_terminate(&result);
+		return NULL;
+	}
+	classify_pool_t *pool = NULL;
+	if (nb_threads > 1) {
+		pool = classify_pool_create(&decoder, nb_threads);
+		if (!pool) {
+			decoder_terminate(&decoder);
+			buffer_terminate(&result);
+			return NULL;
+		}
+	}
 
-	/* This cast is safe as per the check above*/
-	size_t i = (size_t)start;
-
-	dtmf_button_t *btn = NULL;
-	size_t consecutive_presses = 0;
-	while ((i + len) < dtmf->buffer.len) {
-		/* First check for silence */
-		if (is_silence((int16_t *)dtmf->buffer.data + i, len,
-			       target_amplitude)) {
-			/*
-			 * btn will never be NULL here since we only get here after
-			 * `find_start_of_file` detects the first button press 
-			 */
-			assert(btn);
-			push_decoded(btn, &result, &consecutive_presses);
-			i += samples_to_skip_on_silence;
+	while (ret == 0 &&
+	       (decoder.next_window + decoder.len) < dtmf->buffer.len) {
+		/* Finding the start is sequential by nature */
+		if (decoder.phase == DECODER_PHASE_FIND_START) {
+			int16_t min, max;
+			envelope_range(envelope, decoder.next_window,
+				       decoder.next_window + decoder.len, &min,
+				       &max);
+			decoder_find_start(&decoder,
+					   signal + decoder.next_window, max);
 			continue;
 		}
 
-		/* No silence here, decode the button */
-		dtmf_button_t *new_btn =
-			decode_button_fn((int16_t *)dtmf->buffer.data + i,
-					 buffer, len, dtmf->sample_rate);
-
-		/* 
-		 * Failed to decode the button so this must be noise,
-		 * the last button and the number of presses indicates the character to decode
-		 */
-		if (!new_btn) {
-			/* 
-			 * If button is still NULL here, it means we weren't able to decode the first 
-			 * button press. No point in trying, just fail
-			 */
-			if (!btn) {
-				printf("Failed to decode the first button press... Sorry :(\n");
-				free(buffer);
-				buffer_terminate(&result);
-				return NULL;
-			}
-
-			push_decoded(btn, &result, &consecutive_presses);
-			/* 
-			 * Since we know the pause between button presses takes either SAME_CHAR_PAUSE_DURATION  time
-			 * or CHAR_PAUSE_DURATION time, if we get here it means the pause is of CHAR_PAUSE_DURATION time
-			 * Simply skip the correct amount of samples and next loop we should detect the next button press
-			 */
-			i += samples_to_skip_on_silence;
-			continue;
+		size_t leading_silences;
+		ret = segment_windows(&decoder, envelope, windows,
+				      &leading_silences);
+		if (ret == 0) {
+			classify_windows(&decoder, pool, signal, windows);
+			ret = replay_windows(&decoder, windows,
+					     leading_silences);
 		}
-		/*
-		 * If we get here it either means this is the first time this button is getting pressed
-		 * or it's the same button we detected earlier 
-		 */
-		btn = new_btn;
-		consecutive_presses++;
-		/* 
-		 * Since we know a press must take CHAR_SOUND_DURATION time
-		 * and then we will have at least SAME_CHAR_PAUSE_DURATION time
-		 * We can simply skip that amount of samples
-		 */
-		i += samples_to_skip_on_press;
+	}
+
+	classify_pool_destroy(pool);
+	decoder_terminate(&decoder);
+	if (ret < 0) {
+		buffer_terminate(&result);
+		return NULL;
 	}
 
 	/* If the file ended without a silence, add the last button */
-	if (consecutive_presses != 0) {
-		const char decoded =
-			dtmf_decode_character(btn, consecutive_presses);
-		buffer_push(&result, &decoded);
-	}
-	const char terminator = '\0';
-	buffer_push(&result, &terminator);
-	free(buffer);
+	decoder_flush(&decoder);
+	buffer_push_char(&result, '\0');
 	return (char *)result.data;
 }
 
-void dtmf_terminate(dtmf_t *dtmf)
+char *dtmf_decode_parallel(dtmf_decoder_ctx_t *ctx, dtmf_t *dtmf,
+			   dtmf_decode_mode_t mode, size_t nb_threads)
 {
-	buffer_terminate(&dtmf->buffer);
+	switch (mode) {
+	case DTMF_DECODE_FREQUENCY_DOMAIN:
+		return dtmf_decode_internal(ctx, dtmf,
+					    decode_button_frequency_domain,
+					    decode_button_frequency_domain,
+					    nb_threads);
+	case DTMF_DECODE_TIME_DOMAIN:
+		return dtmf_decode_internal(ctx, dtmf,
+					    decode_button_frequency_domain,
+					    decode_button_time_domain,
+					    nb_threads);
+	case DTMF_DECODE_TIME_DOMAIN_COMBINED:
+		return dtmf_decode_internal(ctx, dtmf,
+					    decode_button_frequency_domain,
+					    decode_button_time_domain_combined,
+					    nb_threads);
+	case DTMF_DECODE_GOERTZEL:
+		return dtmf_decode_internal(ctx, dtmf, decode_button_goertzel,
+					    decode_button_goertzel, nb_threads);
+	case DTMF_DECODE_SLIDING:
+		/* Every sample depends on the previous ones */
+		return dtmf_decode_sliding(ctx, dtmf);
+	}
+	return NULL;
 }
-static ssize_t find_start_of_file(dtmf_t *dtmf, cplx_t *buffer, size_t len,
-				  int16_t *amplitude)
+
+dtmf_decoder_t *dtmf_decoder_create(dtmf_decoder_ctx_t *ctx,
+				    dtmf_decode_mode_t mode,
+				    dtmf_decoder_char_cb_t on_char,
+				    void *user_data)
 {
-	assert(is_power_of_2(len));
-	uint32_t f1 = 0, f2 = 0;
-	size_t i = 0;
+	dtmf_decode_button_cb_t detect_button_fn;
+	dtmf_decode_button_cb_t decode_button_fn;
 
-	while ((i + len) < dtmf->buffer.len) {
-		float_to_cplx_t((int16_t *)dtmf->buffer.data + i, buffer, len);
+	switch (mode) {
+	case DTMF_DECODE_FREQUENCY_DOMAIN:
+		detect_button_fn = decode_button_frequency_domain;
+		decode_button_fn = decode_button_frequency_domain;
+		break;
+	case DTMF_DECODE_TIME_DOMAIN:
+		detect_button_fn = decode_button_frequency_domain;
+		decode_button_fn = decode_button_time_domain;
+		break;
+	case DTMF_DECODE_TIME_DOMAIN_COMBINED:
+		detect_button_fn = decode_button_frequency_domain;
+		decode_button_fn = decode_button_time_domain_combined;
+		break;
+	case DTMF_DECODE_GOERTZEL:
+		detect_button_fn = decode_button_goertzel;
+		decode_button_fn = decode_button_goertzel;
+		break;
+	case DTMF_DECODE_SLIDING:
+		detect_button_fn = NULL;
+		decode_button_fn = NULL;
+		break;
+	default:
+		return NULL;
+	}
 
-		int err = fft(buffer, len);
-		if (err != 0) {
-			printf("Error running fft\n");
-			return -1;
+	dtmf_decoder_t *decoder = malloc(sizeof(*decoder));
+	if (!decoder) {
+		return NULL;
+	}
+	const bool sliding = mode == DTMF_DECODE_SLIDING;
+	if (decoder_init(decoder, ctx, detect_button_fn, decode_button_fn,
+			 on_char, user_data, !sliding) < 0) {
+		free(decoder);
+		return NULL;
+	}
+	if (sliding) {
+		decoder->sliding = sliding_tracker_create(
+			decoder->sample_rate, 1, sliding_emit_decoder, decoder);
+		if (!decoder->sliding) {
+			decoder_terminate(decoder);
+			free(decoder);
+			return NULL;
 		}
-		extract_frequencies(buffer, len, dtmf->sample_rate, &f1, &f2);
-
-		if (is_valid_frequency(f1) && is_valid_frequency(f2)) {
-			/* Found the start of the file */
-			int16_t max_amplitude = get_max_amplitude(
-				(int16_t *)dtmf->buffer.data + i, len);
-
-			*amplitude = max_amplitude - (max_amplitude / 10);
-			return i;
-		} else {
-			i += len;
+	}
+	if (ctx->tables->decimate) {
+		const decimator_filter_t *filter = &ctx->tables->filter;
+		if (decimator_init(&decoder->decimator, filter) < 0 ||
+		    !(decoder->decimated = malloc(
+			      decimator_max_output(&decoder->decimator,
+						   STREAM_DECIMATE_CHUNK) *
+			      sizeof(*decoder->decimated)))) {
+			decoder_terminate(decoder);
+			free(decoder);
+			return NULL;
 		}
 	}
-	return i;
+	return decoder;
 }
-static int push_decoded(dtmf_button_t *btn, buffer_t *result, size_t *presses)
+
+int dtmf_decoder_feed(dtmf_decoder_t *decoder, const int16_t *samples,
+		      size_t n)
 {
-	const char decoded = dtmf_decode_character(btn, *presses);
-	*presses = 0;
-	return buffer_push(result, &decoded);
+	if (!decoder->decimated) {
+		return decoder_feed(decoder, samples, n);
+	}
+	while (n > 0) {
+		const size_t chunk = MIN(n, STREAM_DECIMATE_CHUNK);
+		const size_t produced = decimator_process(
+			&decoder->decimator, samples, chunk, decoder->decimated);
+		if (decoder_feed(decoder, decoder->decimated, produced) < 0) {
+			return -1;
+		}
+		samples += chunk;
+		n -= chunk;
+	}
+	return 0;
 }
 
-static int16_t get_max_amplitude(const int16_t *buffer, size_t len)
+/* Feeds samples at the analysis rate */
+static int decoder_feed(dtmf_decoder_t *decoder, const int16_t *samples,
+			size_t n)
 {
-	int16_t amplitude = 0;
+	if (decoder->phase == DECODER_PHASE_FAILED) {
+		return -1;
+	}
+	if (decoder->sliding) {
+		sliding_feed(decoder->sliding, samples, n);
+		return 0;
+	}
+	const size_t mask = decoder->history_capacity - 1;
 
-	for (size_t i = 0; i < len; ++i) {
-		if (buffer[i] > amplitude) {
-			amplitude = buffer[i];
+	while (n > 0) {
+		const size_t end = decoder->history_start + decoder->history_len;
+		/* Samples before the next window will never be looked at */
+		if (end < decoder->next_window) {
+			const size_t skip =
+				MIN(n, decoder->next_window - end);
+			samples += skip;
+			n -= skip;
+			decoder->history_start = end + skip;
+			continue;
+		}
+
+		const size_t to_copy =
+			MIN(n, decoder->history_capacity - decoder->history_len);
+		const size_t tail =
+			(decoder->history_head + decoder->history_len) & mask;
+		const size_t first = MIN(to_copy, decoder->history_capacity - tail);
+		memcpy(decoder->history + tail, samples,
+		       first * sizeof(*samples));
+		memcpy(decoder->history, samples + first,
+		       (to_copy - first) * sizeof(*samples));
+		decoder->history_len += to_copy;
+		samples += to_copy;
+		n -= to_copy;
+
+		/* 
+		 * Like the batch decoder, only look at a window once at least
+		 * one sample after it is available
+		 */
+		while (decoder->next_window + decoder->len <
+		       decoder->history_start + decoder->history_len) {
+			if (decoder_process_window(
+				    decoder, history_window(decoder)) < 0) {
+				return -1;
+			}
+			history_discard(decoder);
 		}
 	}
-	return amplitude;
+	return 0;
 }
 
-static bool is_silence(const int16_t *buffer, size_t len, int16_t target)
+void dtmf_decoder_reset(dtmf_decoder_t *decoder)
 {
-	for (size_t i = 0; i < len; ++i) {
-		/*printf("buffer[i] >= target %d >= %d\n", buffer[i], target);*/
-		if (buffer[i] >= target) {
-			return false;
-		}
+	decoder->phase = DECODER_PHASE_FIND_START;
+	decoder->next_window = 0;
+	decoder->target_amplitude = 0;
+	decoder->btn = NULL;
+	decoder->consecutive_presses = 0;
+	decoder->history_head = 0;
+	decoder->history_start = 0;
+	decoder->history_len = 0;
+	if (decoder->sliding) {
+		sliding_tracker_reset(decoder->sliding);
+	}
+	if (decoder->decimated) {
+		decimator_reset(&decoder->decimator);
 	}
-	return true;
 }
 
-static bool is_valid_frequency(uint32_t freq)
+void dtmf_decoder_finish(dtmf_decoder_t *decoder)
 {
-	return freq > MIN_FREQ && freq < MAX_FREQ;
+	if (decoder->phase == DECODER_PHASE_FAILED) {
+		return;
+	}
+	if (decoder->sliding) {
+		sliding_flush(decoder->sliding);
+		return;
+	}
+	decoder_flush(decoder);
 }
 
-uint64_t dot_product(const int16_t *x, const int16_t *y, size_t len)
+void dtmf_decoder_terminate(dtmf_decoder_t *decoder)
 {
-	int64_t dot = 0;
-	for (size_t i = 0; i < len; ++i) {
-		dot += x[i] * y[i];
-	}
-	return dot >= 0 ? dot : -dot;
+	decoder_terminate(decoder);
+	free(decoder);
 }
 
-static dtmf_button_t *decode_button_frequency_domain(const int16_t *signal,
-						     cplx_t *buffer, size_t len,
-						     uint32_t sample_rate)
+static int decoder_init(dtmf_decoder_t *decoder, dtmf_decoder_ctx_t *ctx,
+			dtmf_decode_button_cb_t detect_button_fn,
+			dtmf_decode_button_cb_t decode_button_fn,
+			dtmf_decoder_char_cb_t on_char, void *user_data,
+			bool with_history)
 {
-	uint32_t f1, f2;
-	float_to_cplx_t(signal, buffer, len);
-	int err = fft(buffer, len);
-	if (err != 0) {
-		printf("Error running fft\n");
-		return NULL;
+	const uint32_t sample_rate = ctx->tables->sample_rate;
+	fft_scratch_t *scratch = NULL;
+	if (detect_button_fn == decode_button_frequency_domain ||
+	    decode_button_fn == decode_button_frequency_domain) {
+		scratch = context_fft_scratch(ctx);
+		if (!scratch) {
+			return -1;
+		}
 	}
-	extract_frequencies(buffer, len, sample_rate, &f1, &f2);
 
-	if (!(is_valid_frequency(f1) && is_valid_frequency(f2))) {
-		return NULL;
+	*decoder = (dtmf_decoder_t){
+		.sample_rate = sample_rate,
+		.len = ctx->tables->len,
+		.samples_to_skip_on_silence =
+			decode_samples_to_skip_on_silence(sample_rate),
+		.samples_to_skip_on_press =
+			decode_samples_to_skip_on_press(sample_rate),
+		.detect_button_fn = detect_button_fn,
+		.decode_button_fn = decode_button_fn,
+		.tables = ctx->tables,
+		.scratch = scratch,
+		.on_char = on_char,
+		.user_data = user_data,
+		.phase = DECODER_PHASE_FIND_START,
+	};
+
+	if (with_history) {
+		/* One window plus the sample confirming it is complete */
+		decoder->history_capacity =
+			align_to_power_of_2(decoder->len + 1);
+		decoder->history = malloc(decoder->history_capacity *
+					  sizeof(*decoder->history));
+		decoder->window = malloc(decoder->len * sizeof(*decoder->window));
+		if (!decoder->history || !decoder->window) {
+			decoder_terminate(decoder);
+			return -1;
+		}
 	}
-	return dtmf_get_closest_button(f1, f2);
+	return 0;
 }
-static void generate_reference_signals(size_t len, uint32_t sample_rate)
+
+static void decoder_terminate(dtmf_decoder_t *decoder)
 {
-	button_reference_signals =
-		malloc(NB_BUTTONS * len * sizeof(*button_reference_signals));
+	free(decoder->history);
+	free(decoder->window);
+	decoder->history = NULL;
+	decoder->window = NULL;
+	sliding_tracker_terminate(decoder->sliding);
+	decoder->sliding = NULL;
+	decimator_terminate(&decoder->decimator);
+	free(decoder->decimated);
+	decoder->decimated = NULL;
+}
 
-	for (size_t i = 0; i < ARRAY_LEN(ROW_FREQUENCIES); ++i) {
-		for (size_t j = 0; j < ARRAY_LEN(COL_FREQUENCIES); ++j) {
-			const size_t window_index =
-				(i * ARRAY_LEN(COL_FREQUENCIES) + j) * len;
+/*
+ * Runs one step of the decoding on the window starting at next_window and
+ * moves next_window to the position of the next window to look at
+ */
+static int decoder_process_window(dtmf_decoder_t *decoder,
+				  const int16_t *window)
+{
+	const size_t len = decoder->len;
 
-			for (size_t k = 0; k < len; ++k) {
-				button_reference_signals[window_index + k] =
-					s(100, ROW_FREQUENCIES[i],
-					  COL_FREQUENCIES[j], k, sample_rate);
-			}
-		}
+	if (decoder->phase == DECODER_PHASE_FIND_START) {
+		int16_t min, max;
+		get_amplitude_range(window, len, &min, &max);
+		decoder_find_start(decoder, window, max);
+		return 0;
+	}
+
+	/* First check for silence */
+	if (is_silence(window, len, decoder->target_amplitude)) {
+		return decoder_advance(decoder, true, NULL);
 	}
+
+	/* No silence here, decode the button */
+	dtmf_button_t *new_btn = decoder->decode_button_fn(
+		window, decoder->tables, decoder->scratch);
+	return decoder_advance(decoder, false, new_btn);
 }
 
-static dtmf_button_t *decode_button_time_domain(const int16_t *signal,
-						cplx_t *buffer, size_t len,
-						uint32_t sample_rate)
+/*
+ * Start detection on the window at next_window whose highest sample is max,
+ * which sets the silence threshold once the start is found
+ */
+static void decoder_find_start(dtmf_decoder_t *decoder, const int16_t *window,
+			       int16_t max)
 {
-	(void)buffer;
-	(void)len;
-	const size_t nb_samples = 5 * (sample_rate / ROW_FREQUENCIES[0]);
-	assert(nb_samples <= len);
+	if (!decoder->detect_button_fn(window, decoder->tables,
+				       decoder->scratch)) {
+		decoder->next_window += decoder->len;
+		return;
+	}
+	/* Found the start of the file, decode this same window next */
+	const int16_t max_amplitude = max > 0 ? max : 0;
+	decoder->target_amplitude = max_amplitude - (max_amplitude / 10);
+	decoder->phase = DECODER_PHASE_DECODE;
+}
 
-	if (!generated_references) {
-		generate_reference_signals(nb_samples, sample_rate);
-		/* Make sure we only do this once*/
-		generated_references = true;
+/*
+ * Updates the decoding state with the classification of the window at
+ * next_window: either a silence or the decoded button (NULL if it couldn't be
+ * decoded)
+ */
+static int decoder_advance(dtmf_decoder_t *decoder, bool silence,
+			   dtmf_button_t *new_btn)
+{
+	if (silence) {
+		/*
+		 * btn will never be NULL here since we only get here after
+		 * the start detection found the first button press 
+		 */
+		assert(decoder->btn);
+		decoder_emit(decoder);
+		decoder->next_window += decoder->samples_to_skip_on_silence;
+		return 0;
 	}
 
-	uint16_t f1 = 0;
-	uint16_t f2 = 0;
-	uint64_t best_corr = 0;
-	for (size_t i = 0; i < ARRAY_LEN(ROW_FREQUENCIES); ++i) {
-		const uint16_t row_freq = ROW_FREQUENCIES[i];
-		for (size_t j = 0; j < ARRAY_LEN(COL_FREQUENCIES); ++j) {
-			const uint16_t col_freq = COL_FREQUENCIES[j];
-			const size_t index =
+	/* 
+	 * Failed to decode the button so this must be noise,
+	 * the last button and the number of presses indicates the character to decode
+	 */
+	if (!new_btn) {
+		/* 
+		 * If button is still NULL here, it means we weren't able to decode the first 
+		 * button press. No point in trying, just fail
+		 */
+		if (!decoder->btn) {
+			fprintf(stderr,
+				"Failed to decode the first button press... Sorry :(\n");
+			decoder->phase = DECODER_PHASE_FAILED;
+			return -1;
+		}
+
+		decoder_emit(decoder);
+		/* 
+		 * Since we know the pause between button presses takes either SAME_CHAR_PAUSE_DURATION  time
+		 * or CHAR_PAUSE_DURATION time, if we get here it means the pause is of CHAR_PAUSE_DURATION time
+		 * Simply skip the correct amount of samples and next loop we should detect the next button press
+		 */
+		decoder->next_window += decoder->samples_to_skip_on_silence;
+		return 0;
+	}
+	/*
+	 * If we get here it either means this is the first time this button is getting pressed
+	 * or it's the same button we detected earlier 
+	 */
+	decoder->btn = new_btn;
+	decoder->consecutive_presses++;
+	/* 
+	 * Since we know a press must take CHAR_SOUND_DURATION time
+	 * and then we will have at least SAME_CHAR_PAUSE_DURATION time
+	 * We can simply skip that amount of samples
+	 */
+	decoder->next_window += decoder->samples_to_skip_on_press;
+	return 0;
+}
+
+static void decoder_emit(dtmf_decoder_t *decoder)
+{
+	const char decoded = dtmf_decode_character(
+		decoder->btn, decoder->consecutive_presses);
+	decoder->consecutive_presses = 0;
+	decoder->on_char(decoded, decoder->user_data);
+}
+
+static void decoder_flush(dtmf_decoder_t *decoder)
+{
+	if (decoder->consecutive_presses != 0) {
+		decoder_emit(decoder);
+	}
+}
+
+/* Returns the window starting at next_window as a contiguous array */
+static const int16_t *history_window(dtmf_decoder_t *decoder)
+{
+	const size_t mask = decoder->history_capacity - 1;
+	const size_t start =
+		(decoder->history_head + decoder->next_window -
+		 decoder->history_start) &
+		mask;
+
+	if (start + decoder->len <= decoder->history_capacity) {
+		return decoder->history + start;
+	}
+	const size_t first = decoder->history_capacity - start;
+	memcpy(decoder->window, decoder->history + start,
+	       first * sizeof(*decoder->window));
+	memcpy(decoder->window + first, decoder->history,
+	       (decoder->len - first) * sizeof(*decoder->window));
+	return decoder->window;
+}
+
+/* Drops the samples that are before next_window */
+static void history_discard(dtmf_decoder_t *decoder)
+{
+	const size_t end = decoder->history_start + decoder->history_len;
+	const size_t drop = MIN(decoder->next_window, end) -
+			    decoder->history_start;
+
+	decoder->history_head =
+		(decoder->history_head + drop) & (decoder->history_capacity - 1);
+	decoder->history_start += drop;
+	decoder->history_len -= drop;
+}
+
+/*
+ * Lists the windows the state machine will visit from next_window on if
+ * every non silent window decodes to a button. Silent windows are only
+ * counted, in the previous window or in leading_silences
+ */
+static int segment_windows(const dtmf_decoder_t *decoder,
+			   const envelope_t *envelope, buffer_t *windows,
+			   size_t *leading_silences)
+{
+	windows->len = 0;
+	*leading_silences = 0;
+	size_t i = decoder->next_window;
+	while ((i + decoder->len) < envelope->len &&
+	       windows->len < SEGMENT_MAX_WINDOWS) {
+		if (envelope_is_silence(envelope, i, decoder->len,
+					decoder->target_amplitude)) {
+			if (windows->len == 0) {
+				(*leading_silences)++;
+			} else {
+				window_t *windows_data = windows->data;
+				windows_data[windows->len - 1].silences_after++;
+			}
+			i += decoder->samples_to_skip_on_silence;
+			continue;
+		}
+
+		const window_t window = {
+			.data_offset = i,
+			.button_index = WINDOW_NO_BUTTON,
+			.silences_after = 0,
+		};
+		if (buffer_push_window(windows, window) < 0) {
+			printf("Failed to allocate memory for decode windows\n");
+			return -1;
+		}
+		i += decoder->samples_to_skip_on_press;
+	}
+	return 0;
+}
+
+static classify_pool_t *classify_pool_create(const dtmf_decoder_t *decoder,
+					     size_t nb_threads)
+{
+	classify_pool_t *pool = calloc(1, sizeof(*pool));
+	if (pool) {
+		pool->workers = calloc(nb_threads, sizeof(*pool->workers));
+	}
+	if (!pool || !pool->workers) {
+		printf("Failed to allocate memory for decode workers\n");
+		free(pool);
+		return NULL;
+	}
+	atomic_init(&pool->job.next, 0);
+	pthread_mutex_init(&pool->lock, NULL);
+	pthread_cond_init(&pool->job_ready, NULL);
+	pthread_cond_init(&pool->job_done, NULL);
+
+	for (; pool->nb_workers < nb_threads; ++pool->nb_workers) {
+		classify_worker_t *worker = &pool->workers[pool->nb_workers];
+		worker->pool = pool;
+		/* Each worker needs its own fft scratch */
+		if (decoder->decode_button_fn == decode_button_frequency_domain &&
+		    fft_scratch_init(&worker->scratch, decoder->len) < 0) {
+			printf("Failed to allocate memory for decode\n");
+			break;
+		}
+		if (pthread_create(&worker->thread, NULL, classify_worker,
+				   worker) != 0) {
+			printf("Failed to start decode worker\n");
+			fft_scratch_terminate(&worker->scratch);
+			break;
+		}
+	}
+
+	/* The workers that did start are enough to go through the windows */
+	if (pool->nb_workers == 0) {
+		classify_pool_destroy(pool);
+		return NULL;
+	}
+	return pool;
+}
+
+static void classify_pool_destroy(classify_pool_t *pool)
+{
+	if (!pool) {
+		return;
+	}
+	pthread_mutex_lock(&pool->lock);
+	pool->stop = true;
+	pthread_cond_broadcast(&pool->job_ready);
+	pthread_mutex_unlock(&pool->lock);
+
+	for (size_t i = 0; i < pool->nb_workers; ++i) {
+		pthread_join(pool->workers[i].thread, NULL);
+		fft_scratch_terminate(&pool->workers[i].scratch);
+	}
+	pthread_cond_destroy(&pool->job_done);
+	pthread_cond_destroy(&pool->job_ready);
+	pthread_mutex_destroy(&pool->lock);
+	free(pool->workers);
+	free(pool);
+}
+
+static void classify_windows(const dtmf_decoder_t *decoder,
+			     classify_pool_t *pool, const int16_t *signal,
+			     buffer_t *windows)
+{
+	if (!pool) {
+		classify_range(decoder, signal, windows->data, 0, windows->len,
+			       decoder->scratch);
+		return;
+	}
+
+	pthread_mutex_lock(&pool->lock);
+	pool->job.decoder = decoder;
+	pool->job.signal = signal;
+	pool->job.windows = windows->data;
+	pool->job.nb_windows = windows->len;
+	atomic_store(&pool->job.next, 0);
+	pool->nb_running = pool->nb_workers;
+	pool->generation++;
+	pthread_cond_broadcast(&pool->job_ready);
+	while (pool->nb_running > 0) {
+		pthread_cond_wait(&pool->job_done, &pool->lock);
+	}
+	pthread_mutex_unlock(&pool->lock);
+}
+
+static void classify_range(const dtmf_decoder_t *decoder,
+			   const int16_t *signal, window_t *windows,
+			   size_t start, size_t end, fft_scratch_t *scratch)
+{
+	if (decoder->decode_button_fn == decode_button_frequency_domain) {
+		classify_range_frequency_domain(decoder->tables, signal,
+						windows, start, end, scratch);
+		return;
+	}
+	for (size_t i = start; i < end; ++i) {
+		const dtmf_button_t *btn = decoder->decode_button_fn(
+			signal + windows[i].data_offset, decoder->tables,
+			scratch);
+		windows[i].button_index = btn ? btn->index : WINDOW_NO_BUTTON;
+	}
+}
+
+/* decode_button_frequency_domain on FFT_BATCH windows at a time */
+static void classify_range_frequency_domain(const decoder_tables_t *tables,
+					    const int16_t *signal,
+					    window_t *windows, size_t start,
+					    size_t end, fft_scratch_t *scratch)
+{
+	const size_t len = tables->len;
+	assert(scratch->plan.n == len);
+	for (size_t i = start; i < end; i += FFT_BATCH) {
+		const size_t nb_windows = MIN(FFT_BATCH, end - i);
+		const int16_t *batch[FFT_BATCH];
+		for (size_t w = 0; w < nb_windows; ++w) {
+			batch[w] = signal + windows[i + w].data_offset;
+		}
+		rfft_plan_execute_batch(&scratch->plan, batch, nb_windows,
+					&scratch->batch);
+
+		for (size_t w = 0; w < nb_windows; ++w) {
+			uint32_t f1 = 0, f2 = 0;
+			extract_frequencies_batch(&scratch->batch, w, len,
+						  tables->sample_rate, &f1,
+						  &f2);
+			const dtmf_button_t *btn =
+				button_from_frequencies(f1, f2);
+			windows[i + w].button_index =
+				btn ? btn->index : WINDOW_NO_BUTTON;
+		}
+	}
+}
+
+static void *classify_worker(void *arg)
+{
+	classify_worker_t *worker = arg;
+	classify_pool_t *pool = worker->pool;
+	classify_job_t *job = &pool->job;
+	size_t generation = 0;
+
+	pthread_mutex_lock(&pool->lock);
+	while (true) {
+		while (!pool->stop && pool->generation == generation) {
+			pthread_cond_wait(&pool->job_ready, &pool->lock);
+		}
+		if (pool->stop) {
+			break;
+		}
+		generation = pool->generation;
+		pthread_mutex_unlock(&pool->lock);
+
+		while (true) {
+			const size_t start = atomic_fetch_add(
+				&job->next, PARALLEL_CHUNK_WINDOWS);
+			if (start >= job->nb_windows) {
+				break;
+			}
+			const size_t end = MIN(start + PARALLEL_CHUNK_WINDOWS,
+					       job->nb_windows);
+			classify_range(job->decoder, job->signal, job->windows,
+				       start, end, &worker->scratch);
+		}
+
+		pthread_mutex_lock(&pool->lock);
+		if (--pool->nb_running == 0) {
+			pthread_cond_signal(&pool->job_done);
+		}
+	}
+	pthread_mutex_unlock(&pool->lock);
+	return NULL;
+}
+
+/* Runs the classified windows through the state machine */
+static int replay_windows(dtmf_decoder_t *decoder, const buffer_t *windows,
+			  size_t leading_silences)
+{
+	for (size_t i = 0; i < leading_silences; ++i) {
+		if (decoder_advance(decoder, true, NULL) < 0) {
+			return -1;
+		}
+	}
+
+	const window_t *window = windows->data;
+	for (size_t i = 0; i < windows->len; ++i) {
+		dtmf_button_t *btn =
+			window[i].button_index == WINDOW_NO_BUTTON ?
+				NULL :
+				dtmf_get_button_by_index(window[i].button_index);
+		if (decoder_advance(decoder, false, btn) < 0) {
+			return -1;
+		}
+		/* Mispredicted, segment again from where we really are */
+		if (decoder->next_window != window[i].data_offset +
+						    decoder->samples_to_skip_on_press) {
+			return 0;
+		}
+		for (size_t j = 0; j < window[i].silences_after; ++j) {
+			if (decoder_advance(decoder, true, NULL) < 0) {
+				return -1;
+			}
+		}
+	}
+	return 0;
+}
+
+static sliding_tracker_t *sliding_tracker_create(uint32_t sample_rate,
+						 size_t nb_channels,
+						 sliding_char_cb_t on_char,
+						 void *user_data)
+{
+	sliding_tracker_t *tracker = calloc(1, sizeof(*tracker));
+	if (!tracker) {
+		return NULL;
+	}
+	const size_t len = SLIDING_WINDOW_SAMPLES(sample_rate);
+	uint32_t bins[ARRAY_LEN(ROW_FREQUENCIES) +
+		      ARRAY_LEN(GOERTZEL_COL_FREQUENCIES)];
+	size_t nb_bins = 0;
+	for (size_t i = 0; i < ARRAY_LEN(ROW_FREQUENCIES); ++i) {
+		bins[nb_bins++] = lround((double)ROW_FREQUENCIES[i] * len /
+					 sample_rate);
+	}
+	for (size_t i = 0; i < ARRAY_LEN(GOERTZEL_COL_FREQUENCIES); ++i) {
+		bins[nb_bins++] = lround(
+			(double)GOERTZEL_COL_FREQUENCIES[i] * len / sample_rate);
+	}
+	if (sliding_dft_init(&tracker->sdft, len, bins, nb_bins,
+			     nb_channels) < 0) {
+		free(tracker);
+		return NULL;
+	}
+	tracker->nb_channels = nb_channels;
+	tracker->channels = malloc(nb_channels * sizeof(*tracker->channels));
+	tracker->powers = malloc(nb_channels * sizeof(*tracker->powers));
+	tracker->row_power = malloc(nb_channels * sizeof(*tracker->row_power));
+	tracker->col_power = malloc(nb_channels * sizeof(*tracker->col_power));
+	tracker->row = malloc(nb_channels * sizeof(*tracker->row));
+	tracker->col = malloc(nb_channels * sizeof(*tracker->col));
+	tracker->detected = malloc(nb_channels * sizeof(*tracker->detected));
+	if (!tracker->channels || !tracker->powers || !tracker->row_power ||
+	    !tracker->col_power || !tracker->row || !tracker->col ||
+	    !tracker->detected) {
+		sliding_tracker_terminate(tracker);
+		return NULL;
+	}
+	tracker->debounce = SLIDING_DEBOUNCE_DURATION * sample_rate;
+	tracker->char_pause = SLIDING_CHAR_PAUSE_DURATION * sample_rate;
+	tracker->min_energy = (int64_t)len * SLIDING_MIN_RMS * SLIDING_MIN_RMS;
+	tracker->on_char = on_char;
+	tracker->user_data = user_data;
+	sliding_tracker_reset(tracker);
+	return tracker;
+}
+
+static void sliding_tracker_reset(sliding_tracker_t *tracker)
+{
+	sliding_dft_reset(&tracker->sdft);
+	tracker->now = 0;
+	memset(tracker->channels, 0,
+	       tracker->nb_channels * sizeof(*tracker->channels));
+}
+
+static void sliding_tracker_terminate(sliding_tracker_t *tracker)
+{
+	if (!tracker) {
+		return;
+	}
+	sliding_dft_terminate(&tracker->sdft);
+	free(tracker->channels);
+	free(tracker->powers);
+	free(tracker->row_power);
+	free(tracker->col_power);
+	free(tracker->row);
+	free(tracker->col);
+	free(tracker->detected);
+	free(tracker);
+}
+
+/* frames holds nb_channels interleaved samples per frame */
+static void sliding_feed(sliding_tracker_t *tracker, const int16_t *frames,
+			 size_t nb_frames)
+{
+	const size_t nb_channels = tracker->nb_channels;
+
+	for (size_t i = 0; i < nb_frames; ++i) {
+		sliding_dft_push(&tracker->sdft, frames + i * nb_channels);
+		tracker->now++;
+
+		sliding_classify(tracker);
+		for (size_t c = 0; c < nb_channels; ++c) {
+			sliding_update(tracker, c, tracker->detected[c]);
+		}
+	}
+}
+
+static void sliding_flush(sliding_tracker_t *tracker)
+{
+	for (size_t c = 0; c < tracker->nb_channels; ++c) {
+		if (tracker->channels[c].presses != 0) {
+			sliding_emit(tracker, c);
+		}
+	}
+}
+
+/*
+ * Same decision as decode_button_goertzel, on the sliding window of every
+ * channel. The loops run over the channels so they vectorize
+ */
+static void sliding_classify(sliding_tracker_t *tracker)
+{
+	const sliding_dft_t *sdft = &tracker->sdft;
+	const size_t nb_channels = tracker->nb_channels;
+	double *powers = tracker->powers;
+	double *row_power = tracker->row_power;
+	double *col_power = tracker->col_power;
+	uint8_t *row = tracker->row;
+	uint8_t *col = tracker->col;
+
+	for (size_t c = 0; c < nb_channels; ++c) {
+		row_power[c] = 0.;
+		col_power[c] = 0.;
+		row[c] = 0;
+		col[c] = 0;
+	}
+	for (size_t i = 0; i < ARRAY_LEN(ROW_FREQUENCIES); ++i) {
+		sliding_dft_powers(sdft, i, powers);
+		for (size_t c = 0; c < nb_channels; ++c) {
+			const bool higher = powers[c] > row_power[c];
+			row_power[c] = higher ? powers[c] : row_power[c];
+			row[c] = higher ? i : row[c];
+		}
+	}
+	for (size_t i = 0; i < ARRAY_LEN(GOERTZEL_COL_FREQUENCIES); ++i) {
+		sliding_dft_powers(sdft, ARRAY_LEN(ROW_FREQUENCIES) + i, powers);
+		for (size_t c = 0; c < nb_channels; ++c) {
+			const bool higher = powers[c] > col_power[c];
+			col_power[c] = higher ? powers[c] : col_power[c];
+			col[c] = higher ? i : col[c];
+		}
+	}
+
+	for (size_t c = 0; c < nb_channels; ++c) {
+		const int64_t energy = sdft->energy[c];
+		const double tones_energy =
+			2. * (row_power[c] + col_power[c]) / sdft->len;
+		if (energy < tracker->min_energy ||
+		    tones_energy < GOERTZEL_MIN_TONE_RATIO * energy ||
+		    col[c] >= ARRAY_LEN(COL_FREQUENCIES)) {
+			tracker->detected[c] = NULL;
+			continue;
+		}
+		tracker->detected[c] = dtmf_get_closest_button(
+			ROW_FREQUENCIES[row[c]], COL_FREQUENCIES[col[c]]);
+	}
+}
+
+static void sliding_update(sliding_tracker_t *tracker, size_t channel,
+			   dtmf_button_t *btn)
+{
+	sliding_channel_t *state = &tracker->channels[channel];
+
+	if (btn != state->candidate) {
+		state->candidate = btn;
+		state->candidate_since = tracker->now;
+	}
+	if (state->candidate != state->pressed &&
+	    tracker->now - state->candidate_since >= tracker->debounce) {
+		sliding_change_state(tracker, channel);
+	} else if (!state->pressed && state->presses &&
+		   tracker->now - state->released_at > tracker->char_pause) {
+		/* Long enough silence, the character is complete */
+		sliding_emit(tracker, channel);
+	}
+}
+
+/* The candidate held for the debounce duration, it becomes the state */
+static void sliding_change_state(sliding_tracker_t *tracker, size_t channel)
+{
+	sliding_channel_t *state = &tracker->channels[channel];
+	dtmf_button_t *btn = state->candidate;
+
+	if (state->pressed) {
+		state->released_at = state->candidate_since;
+	}
+	state->pressed = btn;
+	if (!btn) {
+		return;
+	}
+	/* Pressing another button without a character pause */
+	if (state->presses && btn != state->btn) {
+		sliding_emit(tracker, channel);
+	}
+	state->btn = btn;
+	state->presses++;
+}
+
+static void sliding_emit(sliding_tracker_t *tracker, size_t channel)
+{
+	sliding_channel_t *state = &tracker->channels[channel];
+	const char decoded = dtmf_decode_character(state->btn, state->presses);
+	state->presses = 0;
+	tracker->on_char(channel, decoded, tracker->user_data);
+}
+
+/* The streaming decoder tracks a single channel */
+static void sliding_emit_decoder(size_t channel, char c, void *user_data)
+{
+	dtmf_decoder_t *decoder = user_data;
+	(void)channel;
+	decoder->on_char(c, decoder->user_data);
+}
+
+/* user_data is one result buffer per channel */
+static void push_channel_result(size_t channel, char c, void *user_data)
+{
+	buffer_push_char(&((buffer_t *)user_data)[channel], c);
+}
+
+/*
+ * Feeds the interleaved frames of every channel to the tracker, decimated
+ * first when the tables decimate
+ */
+static int channels_feed(const decoder_tables_t *tables, const dtmf_t *dtmf,
+			 sliding_tracker_t *tracker)
+{
+	const size_t nb_channels = dtmf->channels;
+	const int16_t *frames = dtmf->buffer.data;
+	size_t nb_frames = dtmf->buffer.len / nb_channels;
+
+	if (!tables->decimate) {
+		sliding_feed(tracker, frames, nb_frames);
+		return 0;
+	}
+
+	/* One decimator per channel, all sharing the filter of the tables */
+	decimator_t *decimators = calloc(nb_channels, sizeof(*decimators));
+	if (!decimators) {
+		return -1;
+	}
+	int ret = 0;
+	for (size_t c = 0; c < nb_channels; ++c) {
+		if (decimator_init(&decimators[c], &tables->filter) < 0) {
+			ret = -1;
+		}
+	}
+	const size_t max_output =
+		decimator_max_output(&decimators[0], STREAM_DECIMATE_CHUNK);
+	int16_t *scratch_in = malloc(STREAM_DECIMATE_CHUNK * sizeof(int16_t));
+	int16_t *scratch_out = malloc(max_output * sizeof(int16_t));
+	int16_t *decimated = malloc(max_output * nb_channels * sizeof(int16_t));
+	if (!scratch_in || !scratch_out || !decimated) {
+		ret = -1;
+	}
+
+	while (ret == 0 && nb_frames > 0) {
+		const size_t chunk = MIN(nb_frames, STREAM_DECIMATE_CHUNK);
+		const size_t produced =
+			decimate_frames(decimators, nb_channels, frames, chunk,
+					scratch_in, scratch_out, decimated);
+		sliding_feed(tracker, decimated, produced);
+		frames += chunk * nb_channels;
+		nb_frames -= chunk;
+	}
+
+	for (size_t c = 0; c < nb_channels; ++c) {
+		decimator_terminate(&decimators[c]);
+	}
+	free(decimators);
+	free(scratch_in);
+	free(scratch_out);
+	free(decimated);
+	return ret;
+}
+
+/*
+ * Decimates every channel of nb_frames interleaved frames, the output frames
+ * are interleaved again. The decimators share their filter so they all
+ * produce the same number of frames, which is returned
+ */
+static size_t decimate_frames(decimator_t *decimators, size_t nb_channels,
+			      const int16_t *frames, size_t nb_frames,
+			      int16_t *scratch_in, int16_t *scratch_out,
+			      int16_t *out)
+{
+	size_t produced = 0;
+	for (size_t c = 0; c < nb_channels; ++c) {
+		for (size_t i = 0; i < nb_frames; ++i) {
+			scratch_in[i] = frames[i * nb_channels + c];
+		}
+		produced = decimator_process(&decimators[c], scratch_in,
+					     nb_frames, scratch_out);
+		for (size_t i = 0; i < produced; ++i) {
+			out[i * nb_channels + c] = scratch_out[i];
+		}
+	}
+	return produced;
+}
+
+static void push_result(char c, void *user_data)
+{
+	buffer_push_char((buffer_t *)user_data, c);
+}
+
+void dtmf_terminate(dtmf_t *dtmf)
+{
+	buffer_terminate(&dtmf->buffer);
+}
+static ssize_t find_start_of_file(dtmf_t *dtmf,
+				  dtmf_decode_button_cb_t detect_button_fn,
+				  const decoder_tables_t *tables,
+				  const envelope_t *envelope,
+				  fft_scratch_t *scratch, int16_t *amplitude)
+{
+	const size_t len = tables->len;
+	size_t i = 0;
+
+	while ((i + len) < dtmf->buffer.len) {
+		if (detect_button_fn((int16_t *)dtmf->buffer.data + i, tables,
+				     scratch)) {
+			/* Found the start of the file */
+			int16_t min, max;
+			envelope_range(envelope, i, i + len, &min, &max);
+			int16_t max_amplitude = max > 0 ? max : 0;
+
+			*amplitude = max_amplitude - (max_amplitude / 10);
+			return i;
+		} else {
+			i += len;
+		}
+	}
+	return i;
+}
+static int fft_scratch_init(fft_scratch_t *scratch, size_t len)
+{
+	if (rfft_plan_init(&scratch->plan, len) != 0) {
+		return -1;
+	}
+	scratch->buffer = calloc(len / 2 + 1, sizeof(*scratch->buffer));
+	if (!scratch->buffer) {
+		rfft_plan_terminate(&scratch->plan);
+		return -1;
+	}
+	if (fft_batch_init(&scratch->batch, len) != 0) {
+		rfft_plan_terminate(&scratch->plan);
+		free(scratch->buffer);
+		scratch->buffer = NULL;
+		return -1;
+	}
+	return 0;
+}
+
+/* Only the FFT based decoders need the scratch, allocated on first use */
+static fft_scratch_t *context_fft_scratch(dtmf_decoder_ctx_t *ctx)
+{
+	if (!ctx->scratch.buffer &&
+	    fft_scratch_init(&ctx->scratch, ctx->tables->len) < 0) {
+		return NULL;
+	}
+	return &ctx->scratch;
+}
+
+static void fft_scratch_terminate(fft_scratch_t *scratch)
+{
+	if (!scratch->buffer) {
+		return;
+	}
+	rfft_plan_terminate(&scratch->plan);
+	free(scratch->buffer);
+	scratch->buffer = NULL;
+	fft_batch_terminate(&scratch->batch);
+}
+
+static int push_decoded(dtmf_button_t *btn, buffer_t *result, size_t *presses)
+{
+	const char decoded = dtmf_decode_character(btn, *presses);
+	*presses = 0;
+	return buffer_push_char(result, decoded);
+}
+
+static void get_amplitude_range(const int16_t *buffer, size_t len,
+				int16_t *min, int16_t *max)
+{
+	int16_t lo = INT16_MAX;
+	int16_t hi = INT16_MIN;
+
+	for (size_t i = 0; i < len; ++i) {
+		if (buffer[i] < lo) {
+			lo = buffer[i];
+		}
+		if (buffer[i] > hi) {
+			hi = buffer[i];
+		}
+	}
+	*min = lo;
+	*max = hi;
+}
+
+static bool is_silence(const int16_t *buffer, size_t len, int16_t target)
+{
+	for (size_t i = 0; i < len; ++i) {
+		/*printf("buffer[i] >= target %d >= %d\n", buffer[i], target);*/
+		if (buffer[i] >= target) {
+			return false;
+		}
+	}
+	return true;
+}
+
+/* Same as is_silence on [start, start + len) without reading the samples */
+static bool envelope_is_silence(const envelope_t *envelope, size_t start,
+				size_t len, int16_t target)
+{
+	int16_t min, max;
+	envelope_range(envelope, start, start + len, &min, &max);
+	return max < target;
+}
+
+static bool is_valid_frequency(uint32_t freq)
+{
+	return freq > MIN_FREQ && freq < MAX_FREQ;
+}
+
+static dtmf_button_t *
+decode_button_frequency_domain(const int16_t *signal,
+			       const decoder_tables_t *tables,
+			       fft_scratch_t *scratch)
+{
+	const size_t len = tables->len;
+	assert(scratch->plan.n == len);
+	uint32_t f1, f2;
+	rfft_plan_execute(&scratch->plan, signal, scratch->buffer);
+	extract_frequencies(scratch->buffer, len, tables->sample_rate, &f1,
+			    &f2);
+	return button_from_frequencies(f1, f2);
+}
+
+static dtmf_button_t *button_from_frequencies(uint32_t f1, uint32_t f2)
+{
+	if (!(is_valid_frequency(f1) && is_valid_frequency(f2))) {
+		return NULL;
+	}
+	return dtmf_get_closest_button(f1, f2);
+}
+
+static decoder_tables_t *decoder_tables_create(uint32_t sample_rate)
+{
+	decoder_tables_t *tables = calloc(1, sizeof(*tables));
+	if (!tables) {
+		return NULL;
+	}
+	atomic_init(&tables->refs, 1);
+	tables->input_rate = sample_rate;
+	if (sample_rate > ANALYSIS_SAMPLE_RATE &&
+	    decimator_filter_init(&tables->filter, sample_rate,
+				  ANALYSIS_SAMPLE_RATE,
+				  DECIMATOR_MAX_PHASES) == 0) {
+		tables->decimate = true;
+		sample_rate = ANALYSIS_SAMPLE_RATE;
+	}
+
+	const size_t min_len = SAME_CHAR_PAUSE_SAMPLES(sample_rate);
+	tables->sample_rate = sample_rate;
+	tables->len = is_power_of_2(min_len) ? min_len :
+					       align_to_power_of_2(min_len);
+	tables->reference_len = 5 * (sample_rate / ROW_FREQUENCIES[0]);
+	assert(tables->reference_len <= tables->len);
+
+	const size_t len = tables->reference_len;
+	tables->references = malloc(NB_BUTTONS * len * sizeof(*tables->references));
+	tables->tone_references = malloc(NB_TONE_REFERENCES * len *
+					 sizeof(*tables->tone_references));
+	if (!tables->references || !tables->tone_references) {
+		free(tables->references);
+		free(tables->tone_references);
+		decimator_filter_terminate(&tables->filter);
+		free(tables);
+		return NULL;
+	}
+	for (size_t i = 0; i < ARRAY_LEN(ROW_FREQUENCIES); ++i) {
+		for (size_t j = 0; j < ARRAY_LEN(COL_FREQUENCIES); ++j) {
+			const size_t window_index =
+				(i * ARRAY_LEN(COL_FREQUENCIES) + j) * len;
+
+			for (size_t k = 0; k < len; ++k) {
+				tables->references[window_index + k] =
+					s(100, ROW_FREQUENCIES[i],
+					  COL_FREQUENCIES[j], k, sample_rate);
+			}
+		}
+	}
+
+	for (size_t i = 0; i < NB_TONES; ++i) {
+		const uint16_t freq =
+			i < ARRAY_LEN(ROW_FREQUENCIES) ?
+				ROW_FREQUENCIES[i] :
+				COL_FREQUENCIES[i - ARRAY_LEN(ROW_FREQUENCIES)];
+		int16_t *in_phase = &tables->tone_references[2 * i * len];
+		int16_t *quadrature = in_phase + len;
+
+		for (size_t k = 0; k < len; ++k) {
+			const double phase = 2. * M_PI * freq * k / sample_rate;
+			in_phase[k] = lround(TONE_REFERENCE_AMPLITUDE * cos(phase));
+			quadrature[k] =
+				lround(TONE_REFERENCE_AMPLITUDE * sin(phase));
+		}
+	}
+
+	for (size_t i = 0; i < ARRAY_LEN(ROW_FREQUENCIES); ++i) {
+		tables->row_coeffs[i] =
+			goertzel_coeff(ROW_FREQUENCIES[i], sample_rate);
+	}
+	for (size_t i = 0; i < ARRAY_LEN(GOERTZEL_COL_FREQUENCIES); ++i) {
+		tables->col_coeffs[i] =
+			goertzel_coeff(GOERTZEL_COL_FREQUENCIES[i], sample_rate);
+	}
+	return tables;
+}
+
+/* Fresh context around existing tables */
+static dtmf_decoder_ctx_t *context_create(decoder_tables_t *tables)
+{
+	dtmf_decoder_ctx_t *ctx = calloc(1, sizeof(*ctx));
+	if (!ctx) {
+		return NULL;
+	}
+	if (buffer_init(&ctx->windows, RESULT_BUFFER_INITIAL_LEN,
+			sizeof(window_t)) < 0) {
+		free(ctx);
+		return NULL;
+	}
+	if (tables->decimate &&
+	    (decimator_init(&ctx->decimator, &tables->filter) < 0 ||
+	     buffer_init(&ctx->decimated, RESULT_BUFFER_INITIAL_LEN,
+			 sizeof(int16_t)) < 0)) {
+		buffer_terminate(&ctx->windows);
+		decimator_terminate(&ctx->decimator);
+		free(ctx);
+		return NULL;
+	}
+	envelope_init(&ctx->envelope);
+	atomic_fetch_add_explicit(&tables->refs, 1, memory_order_relaxed);
+	ctx->tables = tables;
+	return ctx;
+}
+
+static void decoder_tables_release(decoder_tables_t *tables)
+{
+	if (atomic_fetch_sub_explicit(&tables->refs, 1, memory_order_acq_rel) !=
+	    1) {
+		return;
+	}
+	free(tables->references);
+	free(tables->tone_references);
+	decimator_filter_terminate(&tables->filter);
+	free(tables);
+}
+
+static int check_sample_rate(const dtmf_decoder_ctx_t *ctx,
+			     const dtmf_t *dtmf)
+{
+	if (ctx->tables->input_rate != dtmf->sample_rate) {
+		printf("Decoder context is for %u Hz, the signal is %u Hz\n",
+		       ctx->tables->input_rate, dtmf->sample_rate);
+		return -1;
+	}
+	return 0;
+}
+
+/* The window decoders look at a single channel */
+static int check_mono_signal(const dtmf_decoder_ctx_t *ctx,
+			     const dtmf_t *dtmf)
+{
+	if (check_sample_rate(ctx, dtmf) < 0) {
+		return -1;
+	}
+	if (dtmf->channels != 1) {
+		printf("Signal of %u channels, decode it with "
+		       "dtmf_decode_channels\n",
+		       dtmf->channels);
+		return -1;
+	}
+	return 0;
+}
+
+/*
+ * The signal the analysis runs on: dtmf itself, or its decimation to the
+ * analysis rate, kept in the context until the next decode
+ */
+static int analysis_signal(dtmf_decoder_ctx_t *ctx, const dtmf_t *dtmf,
+			   dtmf_t *signal)
+{
+	if (check_mono_signal(ctx, dtmf) < 0) {
+		return -1;
+	}
+	if (!ctx->tables->decimate) {
+		*signal = *dtmf;
+		return 0;
+	}
+
+	buffer_t *decimated = &ctx->decimated;
+	decimator_reset(&ctx->decimator);
+	if (buffer_reserve(decimated,
+			   decimator_max_output(&ctx->decimator,
+						dtmf->buffer.len)) < 0) {
+		printf("Failed to allocate memory for the decimated signal\n");
+		return -1;
+	}
+	decimated->len = decimator_process(&ctx->decimator, dtmf->buffer.data,
+					   dtmf->buffer.len, decimated->data);
+
+	buffer_construct_view(&signal->buffer, decimated->data, decimated->len,
+			      sizeof(int16_t));
+	signal->sample_rate = ctx->tables->sample_rate;
+	signal->channels = dtmf->channels;
+	return 0;
+}
+
+/*
+ * Correlates the window with each row and column tone separately. The in
+ * phase and quadrature references make the result independent of the phase
+ * of the tones in the window, and 7 tones need less work than 12 buttons
+ */
+static dtmf_button_t *decode_button_time_domain(const int16_t *signal,
+						const decoder_tables_t *tables,
+						fft_scratch_t *scratch)
+{
+	(void)scratch;
+	const size_t nb_samples = tables->reference_len;
+	uint64_t dots[NB_TONE_REFERENCES];
+
+	for (size_t i = 0; i < NB_TONE_REFERENCES; ++i) {
+		dots[i] = dot_product(signal,
+				      &tables->tone_references[i * nb_samples],
+				      nb_samples);
+	}
+	return classify_tones(dots);
+}
+
+/* Picks the strongest row and column from the correlations of each tone */
+static dtmf_button_t *classify_tones(const uint64_t *dots)
+{
+	double powers[NB_TONES];
+	for (size_t i = 0; i < NB_TONES; ++i) {
+		const double in_phase = dots[2 * i];
+		const double quadrature = dots[2 * i + 1];
+		powers[i] = in_phase * in_phase + quadrature * quadrature;
+	}
+
+	size_t row = 0;
+	for (size_t i = 1; i < ARRAY_LEN(ROW_FREQUENCIES); ++i) {
+		if (powers[i] > powers[row]) {
+			row = i;
+		}
+	}
+	const double *col_powers = &powers[ARRAY_LEN(ROW_FREQUENCIES)];
+	size_t col = 0;
+	for (size_t i = 1; i < ARRAY_LEN(COL_FREQUENCIES); ++i) {
+		if (col_powers[i] > col_powers[col]) {
+			col = i;
+		}
+	}
+
+	if (powers[row] == 0 || col_powers[col] == 0) {
+		return NULL;
+	}
+	return dtmf_get_closest_button(ROW_FREQUENCIES[row],
+				       COL_FREQUENCIES[col]);
+}
+
+/* Correlates the window with the row + column signal of every button */
+static dtmf_button_t *
+decode_button_time_domain_combined(const int16_t *signal,
+				   const decoder_tables_t *tables,
+				   fft_scratch_t *scratch)
+{
+	(void)scratch;
+	const size_t nb_samples = tables->reference_len;
+
+	uint16_t f1 = 0;
+	uint16_t f2 = 0;
+	uint64_t best_corr = 0;
+	for (size_t i = 0; i < ARRAY_LEN(ROW_FREQUENCIES); ++i) {
+		const uint16_t row_freq = ROW_FREQUENCIES[i];
+		for (size_t j = 0; j < ARRAY_LEN(COL_FREQUENCIES); ++j) {
+			const uint16_t col_freq = COL_FREQUENCIES[j];
+			const size_t index =
 				(i * ARRAY_LEN(COL_FREQUENCIES) + j) *
 				nb_samples;
 			const uint64_t corr = dot_product(
-				signal, &button_reference_signals[index],
+				signal, &tables->references[index],
 				nb_samples);
 
 			if (corr > best_corr) {
@@ -461,3 +2132,50 @@ static dtmf_button_t *decode_button_time_domain(const int16_t *signal,
 	}
 	return dtmf_get_closest_button(f1, f2);
 }
+
+static dtmf_button_t *decode_button_goertzel(const int16_t *signal,
+					     const decoder_tables_t *tables,
+					     fft_scratch_t *scratch)
+{
+	(void)scratch;
+	const size_t len = tables->len;
+
+	size_t row = 0;
+	size_t col = 0;
+	float row_power = 0.f;
+	float col_power = 0.f;
+
+	for (size_t i = 0; i < ARRAY_LEN(ROW_FREQUENCIES); ++i) {
+		const float power =
+			goertzel_power(signal, len, tables->row_coeffs[i]);
+		if (power > row_power) {
+			row_power = power;
+			row = i;
+		}
+	}
+	for (size_t i = 0; i < ARRAY_LEN(GOERTZEL_COL_FREQUENCIES); ++i) {
+		const float power =
+			goertzel_power(signal, len, tables->col_coeffs[i]);
+		if (power > col_power) {
+			col_power = power;
+			col = i;
+		}
+	}
+
+	/*
+	 * A pure tone of amplitude A holds A^2 * len / 2 of energy and gives a
+	 * goertzel power of (A * len / 2)^2, so 2 * power / len is the energy
+	 * of the tone. If the two tones don't account for most of the window
+	 * energy, this is noise (or speech) rather than a button press
+	 */
+	const double energy = signal_energy(signal, len);
+	const double tones_energy = 2. * ((double)row_power + col_power) / len;
+	if (energy == 0 || tones_energy < GOERTZEL_MIN_TONE_RATIO * energy) {
+		return NULL;
+	}
+	if (col >= ARRAY_LEN(COL_FREQUENCIES)) {
+		return NULL;
+	}
+	return dtmf_get_closest_button(ROW_FREQUENCIES[row],
+				       COL_FREQUENCIES[col]);
+}
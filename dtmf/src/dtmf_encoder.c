@@ -1,29 +1,50 @@
 
 #include "dtmf_private.h"
 
-#include <ctype.h>
+#include "utils.h"
+#include <pthread.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <assert.h>
 
-#define SPECIAL_CHARS ".!?,# "
-
-#define SILENCE_F1    0
-#define SILENCE_F2    0
 #define EXTRA_PRESSES 0
+#define NB_BUTTONS    12
+#define AMPLITUDE     (INT16_MAX * 0.4)
+
+/*
+ * Every press is CHAR_SOUND_SAMPLES long and starts at phase 0, so each
+ * button's tone burst only needs to be rendered once per sample rate.
+ * The bursts of a sample rate are rendered by the first encode at that rate
+ * and kept until the process exits. They are read only from then on.
+ */
+typedef struct tone_cache {
+	struct tone_cache *next;
+	uint32_t sample_rate;
+	size_t burst_len;
+	int16_t bursts[]; /* NB_BUTTONS * burst_len samples */
+} tone_cache_t;
+
+static pthread_mutex_t tone_caches_lock = PTHREAD_MUTEX_INITIALIZER;
+static tone_cache_t *tone_caches;
 
-static bool is_char_valid(char c);
 static int encode_internal(buffer_t *buffer, const char *value,
 			   uint32_t sample_rate);
-static int push_samples(buffer_t *buffer, uint32_t f1, uint32_t f2,
-			size_t nb_samples, uint32_t sample_rate);
+static size_t encoded_length(const char *value, uint32_t sample_rate);
+static const tone_cache_t *tone_cache_get(uint32_t sample_rate);
+static tone_cache_t *tone_cache_create(uint32_t sample_rate);
+static const int16_t *tone_cache_burst(const tone_cache_t *cache,
+				       const dtmf_button_t *button);
+static int push_samples(buffer_t *buffer, const int16_t *samples,
+			size_t nb_samples);
+static int push_silence(buffer_t *buffer, size_t nb_samples);
 
 bool dtmf_is_valid(const char *value)
 {
 	assert(value);
-	for (size_t i = 0; i < strlen(value); ++i) {
-		if (!is_char_valid(value[i])) {
+	for (size_t i = 0; value[i] != '\0'; ++i) {
+		if (!dtmf_get_char(value[i])->valid) {
 			printf("Found invalid character at position %zu (%c)\n",
 			       i + 1, value[i]);
 			return false;
@@ -39,15 +60,47 @@ dtmf_err_t dtmf_encode(dtmf_t *dtmf, const char *value)
 	dtmf->channels = 1;
 	dtmf->sample_rate = ENCODE_SAMPLE_RATE;
 
-	const size_t initial_capacity =
-		strlen(value) * CHAR_SOUND_SAMPLES(dtmf->sample_rate);
+	/* Allocate the exact size once so the buffer never has to grow */
+	const size_t length = encoded_length(value, dtmf->sample_rate);
 
-	int err = buffer_init(&dtmf->buffer, initial_capacity, sizeof(int16_t));
+	int err = buffer_init(&dtmf->buffer, length ? length : 1,
+			      sizeof(int16_t));
 
 	if (err < 0) {
 		return DTMF_NO_MEMORY;
 	}
-	return encode_internal(&dtmf->buffer, value, dtmf->sample_rate);
+	err = encode_internal(&dtmf->buffer, value, dtmf->sample_rate);
+	assert(err != DTMF_OK || dtmf->buffer.len == length);
+	return err;
+}
+
+size_t dtmf_encoded_length(const char *value)
+{
+	return encoded_length(value, ENCODE_SAMPLE_RATE);
+}
+
+/* Must follow the exact same layout as encode_internal */
+static size_t encoded_length(const char *value, uint32_t sample_rate)
+{
+	const size_t nb_samples_on_char_pause = CHAR_PAUSE_SAMPLES(sample_rate);
+	const size_t nb_samples_on_same_char_pause =
+		SAME_CHAR_PAUSE_SAMPLES(sample_rate);
+	const size_t nb_samples_on_char = CHAR_SOUND_SAMPLES(sample_rate);
+	size_t length = 0;
+
+	for (size_t i = 0; value[i] != '\0'; ++i) {
+		const dtmf_char_t *c = dtmf_get_char(value[i]);
+		assert(c->valid);
+		const size_t times_to_push =
+			c->presses + c->nb_characters * EXTRA_PRESSES;
+
+		if (i > 0) {
+			length += nb_samples_on_char_pause;
+		}
+		length += times_to_push * nb_samples_on_char +
+			  (times_to_push - 1) * nb_samples_on_same_char_pause;
+	}
+	return length;
 }
 
 static int encode_internal(buffer_t *buffer, const char *value,
@@ -58,62 +111,101 @@ static int encode_internal(buffer_t *buffer, const char *value,
 		SAME_CHAR_PAUSE_SAMPLES(sample_rate);
 	const size_t nb_samples_on_char = CHAR_SOUND_SAMPLES(sample_rate);
 
-	for (size_t i = 0; i < strlen(value); ++i) {
-		const dtmf_button_t *button = dtmf_get_button(value[i]);
-		assert(button);
-		const size_t times_to_push = dtmf_get_times_to_push(
-			button->index, value[i], EXTRA_PRESSES);
+	const tone_cache_t *cache = tone_cache_get(sample_rate);
+	if (!cache) {
+		return DTMF_NO_MEMORY;
+	}
+	int ret = DTMF_OK;
+
+	for (size_t i = 0; value[i] != '\0' && ret == DTMF_OK; ++i) {
+		const dtmf_char_t *c = dtmf_get_char(value[i]);
+		assert(c->valid);
+		const dtmf_button_t *button =
+			dtmf_get_button_by_index(c->button_index);
+		const size_t times_to_push =
+			c->presses + c->nb_characters * EXTRA_PRESSES;
 
-		int err;
-		if (i > 0) {
-			err = push_samples(buffer, SILENCE_F1, SILENCE_F2,
-					   nb_samples_on_char_pause,
-					   sample_rate);
-			if (err < 0) {
-				return DTMF_NO_MEMORY;
-			}
+		const int16_t *burst = tone_cache_burst(cache, button);
+
+		if (i > 0 &&
+		    push_silence(buffer, nb_samples_on_char_pause) < 0) {
+			ret = DTMF_NO_MEMORY;
+			break;
 		}
 		for (size_t j = 0; j < times_to_push; ++j) {
-			if (j > 0) {
-				err = push_samples(
-					buffer, SILENCE_F1, SILENCE_F2,
-					nb_samples_on_same_char_pause,
-					sample_rate);
-				if (err < 0) {
-					return DTMF_NO_MEMORY;
-				}
+			if (j > 0 && push_silence(buffer,
+						  nb_samples_on_same_char_pause) <
+					     0) {
+				ret = DTMF_NO_MEMORY;
+				break;
 			}
-
-			err = push_samples(buffer, button->row_freq,
-					   button->col_freq, nb_samples_on_char,
-					   sample_rate);
-			if (err < 0) {
-				return DTMF_NO_MEMORY;
+			if (push_samples(buffer, burst, nb_samples_on_char) <
+			    0) {
+				ret = DTMF_NO_MEMORY;
+				break;
 			}
 		}
 	}
-	return DTMF_OK;
+	return ret;
 }
 
-static int push_samples(buffer_t *buffer, uint32_t f1, uint32_t f2,
-			size_t nb_samples, uint32_t sample_rate)
+static const tone_cache_t *tone_cache_get(uint32_t sample_rate)
 {
-	if (f1 != 0) {
-		printf("Pushing [%zu,%zu[\n", buffer->len,
-		       buffer->len + nb_samples);
+	pthread_mutex_lock(&tone_caches_lock);
+	tone_cache_t *cache = tone_caches;
+	while (cache && cache->sample_rate != sample_rate) {
+		cache = cache->next;
 	}
-	for (size_t i = 0; i < nb_samples; ++i) {
-		const int16_t value =
-			(int16_t)s(INT16_MAX * 0.4, f1, f2, i, sample_rate);
-		int err = buffer_push(buffer, &value);
-		if (err < 0) {
-			return err;
+	if (!cache) {
+		cache = tone_cache_create(sample_rate);
+		if (cache) {
+			cache->next = tone_caches;
+			tone_caches = cache;
 		}
 	}
-	return 0;
+	pthread_mutex_unlock(&tone_caches_lock);
+	return cache;
+}
+
+static tone_cache_t *tone_cache_create(uint32_t sample_rate)
+{
+	const size_t burst_len = CHAR_SOUND_SAMPLES(sample_rate);
+	tone_cache_t *cache = malloc(
+		sizeof(*cache) + NB_BUTTONS * burst_len * sizeof(int16_t));
+	if (!cache) {
+		return NULL;
+	}
+	cache->next = NULL;
+	cache->sample_rate = sample_rate;
+	cache->burst_len = burst_len;
+
+	for (size_t b = 0; b < NB_BUTTONS; ++b) {
+		const dtmf_button_t *button = dtmf_get_button_by_index(b);
+		int16_t *burst = cache->bursts + b * burst_len;
+		for (size_t i = 0; i < burst_len; ++i) {
+			burst[i] = (int16_t)s(AMPLITUDE, button->row_freq,
+					      button->col_freq, i, sample_rate);
+		}
+	}
+	return cache;
+}
+
+static const int16_t *tone_cache_burst(const tone_cache_t *cache,
+				       const dtmf_button_t *button)
+{
+	assert(button->index < NB_BUTTONS);
+	return cache->bursts + button->index * cache->burst_len;
+}
+
+static int push_samples(buffer_t *buffer, const int16_t *samples,
+			size_t nb_samples)
+{
+	return buffer_append(buffer, samples, nb_samples);
 }
 
-static bool is_char_valid(char c)
+/* s() is 0 everywhere when both frequencies are 0 */
+static int push_silence(buffer_t *buffer, size_t nb_samples)
 {
-	return islower(c) || isdigit(c) || strchr(SPECIAL_CHARS, c) != NULL;
+	const int16_t silence = 0;
+	return buffer_append_fill(buffer, &silence, nb_samples);
 }
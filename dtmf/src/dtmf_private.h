@@ -11,6 +11,14 @@ typedef struct {
 	uint16_t row_freq;
 } dtmf_button_t;
 
+/* Everything the encoder needs to know about a character, see dtmf_get_char */
+typedef struct {
+	uint8_t button_index;
+	uint8_t presses; /* Presses needed to reach the character */
+	uint8_t nb_characters; /* Presses for a full cycle of the button */
+	bool valid; /* Can be encoded */
+} dtmf_char_t;
+
 #define CHAR_SOUND_DURATION		0.2
 #define CHAR_PAUSE_DURATION		0.2
 #define SAME_CHAR_PAUSE_DURATION	0.05
@@ -20,6 +28,13 @@ typedef struct {
 #define SAME_CHAR_PAUSE_SAMPLES(sample_rate) \
 	(SAME_CHAR_PAUSE_DURATION * sample_rate)
 
+extern dtmf_char_t dtmf_chars[256];
+
+static inline const dtmf_char_t *dtmf_get_char(char character)
+{
+	return &dtmf_chars[(unsigned char)character];
+}
+
 dtmf_button_t *dtmf_get_button_by_index(size_t index);
 dtmf_button_t *dtmf_get_button(char character);
 dtmf_button_t *dtmf_get_closest_button(uint16_t f1, uint16_t f2);
@@ -29,4 +44,19 @@ char dtmf_decode_character(dtmf_button_t *button, size_t presses);
 
 int32_t s(int32_t a, uint32_t f1, uint32_t f2, uint32_t t,
 	  uint32_t sample_rate);
+
+/*
+ * References of the full signal of each button, what the FPGA correlates the
+ * windows with: nb_references windows of reference_len samples at the
+ * analysis rate, in button index order
+ */
+const int16_t *dtmf_decoder_ctx_references(const dtmf_decoder_ctx_t *ctx,
+					   size_t *nb_references,
+					   size_t *reference_len);
+/*
+ * Message of the window_t list the FPGA classified, the part of the FPGA
+ * decoders after the correlations. A window without a button continues the
+ * press before it
+ */
+char *dtmf_decode_fpga_windows(const buffer_t *windows);
 #endif
@@ -0,0 +1,237 @@
+#include "envelope.h"
+#include "utils.h"
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+#define BLOCK ENVELOPE_BLOCK_SAMPLES
+
+/* The vector kernels load two registers of 8 samples per block */
+_Static_assert(BLOCK == 16, "build_first_level expects 16 sample blocks");
+
+static void build_first_level(const int16_t *signal, size_t nb_blocks,
+			      int16_t *min, int16_t *max);
+static void samples_range(const int16_t *signal, size_t start, size_t end,
+			  int16_t *min, int16_t *max);
+
+void envelope_init(envelope_t *envelope)
+{
+	memset(envelope, 0, sizeof(*envelope));
+}
+
+int envelope_build(envelope_t *envelope, const int16_t *signal, size_t len)
+{
+	envelope->signal = signal;
+	envelope->len = len;
+	envelope->nb_levels = 0;
+
+	/* Each level is half the previous one, rounded up */
+	const size_t nb_blocks = len / BLOCK;
+	const size_t needed = 2 * nb_blocks + ARRAY_LEN(envelope->level_lens);
+	if (needed > envelope->capacity) {
+		int16_t *min = realloc(envelope->min, needed * sizeof(*min));
+		if (!min) {
+			return -1;
+		}
+		envelope->min = min;
+		int16_t *max = realloc(envelope->max, needed * sizeof(*max));
+		if (!max) {
+			return -1;
+		}
+		envelope->max = max;
+		envelope->capacity = needed;
+	}
+	if (nb_blocks == 0) {
+		return 0;
+	}
+
+	build_first_level(signal, nb_blocks, envelope->min, envelope->max);
+	envelope->level_offsets[0] = 0;
+	envelope->level_lens[0] = nb_blocks;
+	envelope->nb_levels = 1;
+
+	size_t offset = 0;
+	size_t level_len = nb_blocks;
+	while (level_len > 1) {
+		const int16_t *prev_min = envelope->min + offset;
+		const int16_t *prev_max = envelope->max + offset;
+		const size_t next_len = (level_len + 1) / 2;
+		offset += level_len;
+		int16_t *next_min = envelope->min + offset;
+		int16_t *next_max = envelope->max + offset;
+
+		for (size_t i = 0; i < level_len / 2; ++i) {
+			const int16_t a_min = prev_min[2 * i];
+			const int16_t b_min = prev_min[2 * i + 1];
+			const int16_t a_max = prev_max[2 * i];
+			const int16_t b_max = prev_max[2 * i + 1];
+			next_min[i] = a_min < b_min ? a_min : b_min;
+			next_max[i] = a_max > b_max ? a_max : b_max;
+		}
+		if (level_len & 1) {
+			next_min[next_len - 1] = prev_min[level_len - 1];
+			next_max[next_len - 1] = prev_max[level_len - 1];
+		}
+
+		envelope->level_offsets[envelope->nb_levels] = offset;
+		envelope->level_lens[envelope->nb_levels] = next_len;
+		envelope->nb_levels++;
+		level_len = next_len;
+	}
+	return 0;
+}
+
+void envelope_range(const envelope_t *envelope, size_t start, size_t end,
+		    int16_t *min, int16_t *max)
+{
+	size_t first_block = (start + BLOCK - 1) / BLOCK;
+	size_t end_block = end / BLOCK;
+	if (first_block >= end_block) {
+		samples_range(envelope->signal, start, end, min, max);
+		return;
+	}
+
+	/* Partial blocks at the edges */
+	int16_t lo = INT16_MAX;
+	int16_t hi = INT16_MIN;
+	if (start < first_block * BLOCK) {
+		samples_range(envelope->signal, start, first_block * BLOCK, &lo,
+			      &hi);
+	}
+	if (end_block * BLOCK < end) {
+		int16_t tail_lo, tail_hi;
+		samples_range(envelope->signal, end_block * BLOCK, end, &tail_lo,
+			      &tail_hi);
+		lo = tail_lo < lo ? tail_lo : lo;
+		hi = tail_hi > hi ? tail_hi : hi;
+	}
+
+	/* Whole blocks, climbing the pyramid like a segment tree */
+	for (size_t level = 0; first_block < end_block; ++level) {
+		const int16_t *level_min =
+			envelope->min + envelope->level_offsets[level];
+		const int16_t *level_max =
+			envelope->max + envelope->level_offsets[level];
+		if (first_block & 1) {
+			lo = level_min[first_block] < lo ? level_min[first_block] :
+							   lo;
+			hi = level_max[first_block] > hi ? level_max[first_block] :
+							   hi;
+			first_block++;
+		}
+		if (end_block & 1) {
+			end_block--;
+			lo = level_min[end_block] < lo ? level_min[end_block] : lo;
+			hi = level_max[end_block] > hi ? level_max[end_block] : hi;
+		}
+		first_block /= 2;
+		end_block /= 2;
+	}
+	*min = lo;
+	*max = hi;
+}
+
+void envelope_terminate(envelope_t *envelope)
+{
+	free(envelope->min);
+	free(envelope->max);
+	envelope_init(envelope);
+}
+
+static void samples_range(const int16_t *signal, size_t start, size_t end,
+			  int16_t *min, int16_t *max)
+{
+	int16_t lo = INT16_MAX;
+	int16_t hi = INT16_MIN;
+	for (size_t i = start; i < end; ++i) {
+		lo = signal[i] < lo ? signal[i] : lo;
+		hi = signal[i] > hi ? signal[i] : hi;
+	}
+	*min = lo;
+	*max = hi;
+}
+
+#if defined(__SSE2__)
+static inline int16_t horizontal_min(__m128i v)
+{
+	v = _mm_min_epi16(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(1, 0, 3, 2)));
+	v = _mm_min_epi16(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(2, 3, 0, 1)));
+	v = _mm_min_epi16(v, _mm_shufflelo_epi16(v, _MM_SHUFFLE(2, 3, 0, 1)));
+	return (int16_t)_mm_cvtsi128_si32(v);
+}
+
+static inline int16_t horizontal_max(__m128i v)
+{
+	v = _mm_max_epi16(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(1, 0, 3, 2)));
+	v = _mm_max_epi16(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(2, 3, 0, 1)));
+	v = _mm_max_epi16(v, _mm_shufflelo_epi16(v, _MM_SHUFFLE(2, 3, 0, 1)));
+	return (int16_t)_mm_cvtsi128_si32(v);
+}
+
+static void build_first_level(const int16_t *signal, size_t nb_blocks,
+			      int16_t *min, int16_t *max)
+{
+	for (size_t i = 0; i < nb_blocks; ++i) {
+		const __m128i a = _mm_loadu_si128((const __m128i *)signal);
+		const __m128i b = _mm_loadu_si128((const __m128i *)(signal + 8));
+		min[i] = horizontal_min(_mm_min_epi16(a, b));
+		max[i] = horizontal_max(_mm_max_epi16(a, b));
+		signal += BLOCK;
+	}
+}
+#elif defined(__ARM_NEON)
+#if defined(__aarch64__)
+static int16_t horizontal_min(int16x8_t v)
+{
+	return vminvq_s16(v);
+}
+
+static int16_t horizontal_max(int16x8_t v)
+{
+	return vmaxvq_s16(v);
+}
+#else
+/* armv7 has no across vector min / max, fold the halves pairwise */
+static int16_t horizontal_min(int16x8_t v)
+{
+	int16x4_t d = vpmin_s16(vget_low_s16(v), vget_high_s16(v));
+	d = vpmin_s16(d, d);
+	d = vpmin_s16(d, d);
+	return vget_lane_s16(d, 0);
+}
+
+static int16_t horizontal_max(int16x8_t v)
+{
+	int16x4_t d = vpmax_s16(vget_low_s16(v), vget_high_s16(v));
+	d = vpmax_s16(d, d);
+	d = vpmax_s16(d, d);
+	return vget_lane_s16(d, 0);
+}
+#endif
+
+static void build_first_level(const int16_t *signal, size_t nb_blocks,
+			      int16_t *min, int16_t *max)
+{
+	for (size_t i = 0; i < nb_blocks; ++i) {
+		const int16x8_t a = vld1q_s16(signal);
+		const int16x8_t b = vld1q_s16(signal + 8);
+		min[i] = horizontal_min(vminq_s16(a, b));
+		max[i] = horizontal_max(vmaxq_s16(a, b));
+		signal += BLOCK;
+	}
+}
+#else
+static void build_first_level(const int16_t *signal, size_t nb_blocks,
+			      int16_t *min, int16_t *max)
+{
+	for (size_t i = 0; i < nb_blocks; ++i) {
+		samples_range(signal, 0, BLOCK, &min[i], &max[i]);
+		signal += BLOCK;
+	}
+}
+#endif
@@ -0,0 +1,35 @@
+#ifndef ENVELOPE_H
+#define ENVELOPE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Samples summarised by each entry of the first level */
+#define ENVELOPE_BLOCK_SAMPLES 16
+
+/*
+ * Min / max pyramid over a signal. The first level holds the extremes of
+ * each block of ENVELOPE_BLOCK_SAMPLES samples, every following level the
+ * extremes of two entries of the previous one. The min and max of any range
+ * then only look at the partial blocks at its edges plus O(log n) entries.
+ */
+typedef struct {
+	const int16_t *signal;
+	size_t len;
+	size_t nb_levels;
+	size_t level_offsets[sizeof(size_t) * 8];
+	size_t level_lens[sizeof(size_t) * 8];
+	int16_t *min;
+	int16_t *max;
+	size_t capacity; /* Entries allocated in min and max */
+} envelope_t;
+
+void envelope_init(envelope_t *envelope);
+/* signal must outlive the envelope, the allocations are reused */
+int envelope_build(envelope_t *envelope, const int16_t *signal, size_t len);
+/* Extremes of the samples [start, end), end > start */
+void envelope_range(const envelope_t *envelope, size_t start, size_t end,
+		    int16_t *min, int16_t *max);
+void envelope_terminate(envelope_t *envelope);
+
+#endif
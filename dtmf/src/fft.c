@@ -8,26 +8,192 @@
 #include <string.h>
 
 #include "fft.h"
-static void _fft(cplx_t *buf, cplx_t *tmp, size_t n, size_t step);
 
-/*
- * Source: https://rosettacode.org/wiki/Fast_Fourier_transform#C
- */
-int fft(cplx_t *buf, size_t n)
+static size_t reverse_bits(size_t value, size_t nb_bits);
+static void rfft_post_process(const rfft_plan_t *plan, cplx_t *out);
+static void fft_plan_execute_batch(const fft_plan_t *plan, fft_lanes_t *re,
+				   fft_lanes_t *im);
+static void rfft_post_process_batch(const rfft_plan_t *plan, fft_lanes_t *re,
+				    fft_lanes_t *im);
+
+int fft_plan_init(fft_plan_t *plan, size_t n)
 {
 	if (!is_power_of_2(n)) {
 		printf("Can't perform fft if n is not a power of 2\n");
 		return 1;
 	}
 
-	cplx_t *tmp = (cplx_t *)malloc(n * sizeof(cplx_t));
-	if (!tmp) {
+	size_t nb_bits = 0;
+	while (((size_t)1 << nb_bits) < n) {
+		nb_bits++;
+	}
+
+	plan->bit_reversal = malloc(n * sizeof(*plan->bit_reversal));
+	plan->twiddles = malloc((n / 2 + 1) * sizeof(*plan->twiddles));
+	if (!plan->bit_reversal || !plan->twiddles) {
+		free(plan->bit_reversal);
+		free(plan->twiddles);
 		return 1;
 	}
+	plan->n = n;
 
-	memcpy(tmp, buf, n * sizeof(*buf));
-	_fft(buf, tmp, n, 1);
-	free(tmp);
+	for (size_t i = 0; i < n; ++i) {
+		plan->bit_reversal[i] = reverse_bits(i, nb_bits);
+	}
+	for (size_t i = 0; i < n / 2; ++i) {
+		plan->twiddles[i] = cexp(-2.0 * I * M_PI * i / n);
+	}
+	return 0;
+}
+
+/*
+ * Iterative in place radix-2 decimation in time.
+ * Source: https://en.wikipedia.org/wiki/Cooley%E2%80%93Tukey_FFT_algorithm#Data_reordering,_bit_reversal,_and_in-place_algorithms
+ */
+void fft_plan_execute(const fft_plan_t *plan, cplx_t *buf)
+{
+	const size_t n = plan->n;
+
+	for (size_t i = 0; i < n; ++i) {
+		const size_t j = plan->bit_reversal[i];
+		if (i < j) {
+			const cplx_t tmp = buf[i];
+			buf[i] = buf[j];
+			buf[j] = tmp;
+		}
+	}
+
+	for (size_t size = 2; size <= n; size *= 2) {
+		const size_t half = size / 2;
+		const size_t twiddle_step = n / size;
+		for (size_t start = 0; start < n; start += size) {
+			for (size_t i = 0; i < half; ++i) {
+				const cplx_t t =
+					plan->twiddles[i * twiddle_step] *
+					buf[start + i + half];
+				buf[start + i + half] = buf[start + i] - t;
+				buf[start + i] = buf[start + i] + t;
+			}
+		}
+	}
+}
+
+void fft_plan_terminate(fft_plan_t *plan)
+{
+	free(plan->bit_reversal);
+	free(plan->twiddles);
+	plan->bit_reversal = NULL;
+	plan->twiddles = NULL;
+	plan->n = 0;
+}
+
+int rfft_plan_init(rfft_plan_t *plan, size_t n)
+{
+	if (n < 2 || !is_power_of_2(n)) {
+		printf("Can't perform real fft if n is not a power of 2\n");
+		return 1;
+	}
+	if (fft_plan_init(&plan->half, n / 2) != 0) {
+		return 1;
+	}
+	plan->twiddles = malloc((n / 4 + 1) * sizeof(*plan->twiddles));
+	if (!plan->twiddles) {
+		fft_plan_terminate(&plan->half);
+		return 1;
+	}
+	plan->n = n;
+	for (size_t i = 0; i <= n / 4; ++i) {
+		plan->twiddles[i] = cexp(-2.0 * I * M_PI * i / n);
+	}
+	return 0;
+}
+
+void rfft_plan_execute(const rfft_plan_t *plan, const int16_t *in,
+		       cplx_t *out)
+{
+	/* Even samples go in the real part, odd samples in the imaginary one */
+	for (size_t i = 0; i < plan->n / 2; ++i) {
+		out[i] = in[2 * i] + in[2 * i + 1] * I;
+	}
+	fft_plan_execute(&plan->half, out);
+	rfft_post_process(plan, out);
+}
+
+void rfft_plan_execute_float(const rfft_plan_t *plan, const float *in,
+			     cplx_t *out)
+{
+	for (size_t i = 0; i < plan->n / 2; ++i) {
+		out[i] = in[2 * i] + in[2 * i + 1] * I;
+	}
+	fft_plan_execute(&plan->half, out);
+	rfft_post_process(plan, out);
+}
+
+void rfft_plan_terminate(rfft_plan_t *plan)
+{
+	fft_plan_terminate(&plan->half);
+	free(plan->twiddles);
+	plan->twiddles = NULL;
+	plan->n = 0;
+}
+
+int fft_batch_init(fft_batch_t *batch, size_t n)
+{
+	const size_t size = (n / 2 + 1) * sizeof(fft_lanes_t);
+	batch->re = aligned_alloc(sizeof(fft_lanes_t), size);
+	batch->im = aligned_alloc(sizeof(fft_lanes_t), size);
+	if (!batch->re || !batch->im) {
+		free(batch->re);
+		free(batch->im);
+		batch->re = NULL;
+		batch->im = NULL;
+		return 1;
+	}
+	return 0;
+}
+
+void rfft_plan_execute_batch(const rfft_plan_t *plan,
+			     const int16_t *const *in, size_t nb_windows,
+			     fft_batch_t *out)
+{
+	fft_lanes_t *re = out->re;
+	fft_lanes_t *im = out->im;
+
+	/* Transposes the windows, packing even and odd samples like above */
+	for (size_t i = 0; i < plan->n / 2; ++i) {
+		fft_lanes_t even = { 0 };
+		fft_lanes_t odd = { 0 };
+		for (size_t w = 0; w < nb_windows; ++w) {
+			even[w] = in[w][2 * i];
+			odd[w] = in[w][2 * i + 1];
+		}
+		re[i] = even;
+		im[i] = odd;
+	}
+	fft_plan_execute_batch(&plan->half, re, im);
+	rfft_post_process_batch(plan, re, im);
+}
+
+void fft_batch_terminate(fft_batch_t *batch)
+{
+	free(batch->re);
+	free(batch->im);
+	batch->re = NULL;
+	batch->im = NULL;
+}
+
+/*
+ * One shot helper. Prefer keeping a plan around when running multiple ffts
+ * of the same length
+ */
+int fft(cplx_t *buf, size_t n)
+{
+	fft_plan_t plan;
+	if (fft_plan_init(&plan, n) != 0) {
+		return 1;
+	}
+	fft_plan_execute(&plan, buf);
+	fft_plan_terminate(&plan);
 	return 0;
 }
 
@@ -59,27 +225,149 @@ void extract_frequencies(const cplx_t *buf, size_t n, double sample_rate,
 	}
 }
 
+void extract_frequencies_batch(const fft_batch_t *batch, size_t window,
+			       size_t n, double sample_rate, uint32_t *f1,
+			       uint32_t *f2)
+{
+	const size_t half = n / 2;
+	double mag_f1 = 0;
+	double mag_f2 = 0;
+
+	for (size_t i = 0; i < half; ++i) {
+		/* cabs is hypot on the double promoted parts */
+		const double magnitude =
+			hypot(batch->re[i][window], batch->im[i][window]) / n;
+		const double frequency = (i * sample_rate) / n;
+		if (magnitude > mag_f1) {
+			mag_f2 = mag_f1;
+			mag_f1 = magnitude;
+			*f2 = *f1;
+			*f1 = frequency;
+		} else if (magnitude > mag_f2) {
+			mag_f2 = magnitude;
+			*f2 = frequency;
+		}
+	}
+}
+
+static size_t reverse_bits(size_t value, size_t nb_bits)
+{
+	size_t reversed = 0;
+	for (size_t i = 0; i < nb_bits; ++i) {
+		reversed = (reversed << 1) | (value & 1);
+		value >>= 1;
+	}
+	return reversed;
+}
+
 /*
- * Source: https://rosettacode.org/wiki/Fast_Fourier_transform#C
+ * Splits the n/2 points transform Z of the packed signal into the spectrum of
+ * the even (E) and odd (O) samples and recombines them:
+ *	E[k] = (Z[k] + conj(Z[n/2 - k])) / 2
+ *	O[k] = -i * (Z[k] - conj(Z[n/2 - k])) / 2
+ *	X[k] = E[k] + W^k * O[k]
+ *	X[n/2 - k] = conj(E[k] - W^k * O[k])
+ * Source: https://www.robinscheibler.org/2013/02/13/real-fft.html
  */
-static void _fft(cplx_t *buf, cplx_t *tmp, size_t n, size_t step)
+static void rfft_post_process(const rfft_plan_t *plan, cplx_t *out)
 {
-	if (n < 2) {
-		return;
+	const size_t half = plan->n / 2;
+	const cplx_t z0 = out[0];
+
+	out[0] = crealf(z0) + cimagf(z0);
+	out[half] = crealf(z0) - cimagf(z0);
+
+	for (size_t k = 1; k <= half / 2; ++k) {
+		const size_t m = half - k;
+		const cplx_t zk = out[k];
+		const cplx_t zm = conjf(out[m]);
+		const cplx_t even = 0.5f * (zk + zm);
+		const cplx_t odd = -0.5f * I * (zk - zm);
+		const cplx_t t = plan->twiddles[k] * odd;
+
+		out[k] = even + t;
+		if (k != m) {
+			out[m] = conjf(even - t);
+		}
 	}
-	const size_t half = n / 2;
+}
 
-	for (size_t i = 0; i < half; ++i) {
-		tmp[i] = buf[2 * i];
-		tmp[i + half] = buf[2 * i + 1];
+/* fft_plan_execute with each complex operation spelled out on all the lanes */
+static void fft_plan_execute_batch(const fft_plan_t *plan, fft_lanes_t *re,
+				   fft_lanes_t *im)
+{
+	const size_t n = plan->n;
+
+	for (size_t i = 0; i < n; ++i) {
+		const size_t j = plan->bit_reversal[i];
+		if (i < j) {
+			const fft_lanes_t tmp_re = re[i];
+			const fft_lanes_t tmp_im = im[i];
+			re[i] = re[j];
+			im[i] = im[j];
+			re[j] = tmp_re;
+			im[j] = tmp_im;
+		}
+	}
+
+	for (size_t size = 2; size <= n; size *= 2) {
+		const size_t half = size / 2;
+		const size_t twiddle_step = n / size;
+		for (size_t i = 0; i < half; ++i) {
+			const cplx_t twiddle = plan->twiddles[i * twiddle_step];
+			const float w_re = crealf(twiddle);
+			const float w_im = cimagf(twiddle);
+			for (size_t start = 0; start < n; start += size) {
+				const size_t a = start + i;
+				const size_t b = a + half;
+				const fft_lanes_t t_re =
+					w_re * re[b] - w_im * im[b];
+				const fft_lanes_t t_im =
+					w_re * im[b] + w_im * re[b];
+				re[b] = re[a] - t_re;
+				im[b] = im[a] - t_im;
+				re[a] = re[a] + t_re;
+				im[a] = im[a] + t_im;
+			}
+		}
 	}
+}
 
-	_fft(tmp, buf, half, step * 2);
-	_fft(tmp + half, buf + half, half, step * 2);
+/* rfft_post_process on all the lanes */
+static void rfft_post_process_batch(const rfft_plan_t *plan, fft_lanes_t *re,
+				    fft_lanes_t *im)
+{
+	const size_t half = plan->n / 2;
+	const fft_lanes_t z0_re = re[0];
+	const fft_lanes_t z0_im = im[0];
+	const fft_lanes_t zero = { 0 };
 
-	for (size_t i = 0; i < half; ++i) {
-		const cplx_t t = cexp(-2.0 * I * M_PI * i / n) * tmp[i + half];
-		buf[i] = tmp[i] + t;
-		buf[i + half] = tmp[i] - t;
+	re[0] = z0_re + z0_im;
+	im[0] = zero;
+	re[half] = z0_re - z0_im;
+	im[half] = zero;
+
+	for (size_t k = 1; k <= half / 2; ++k) {
+		const size_t m = half - k;
+		const float w_re = crealf(plan->twiddles[k]);
+		const float w_im = cimagf(plan->twiddles[k]);
+		const fft_lanes_t zk_re = re[k];
+		const fft_lanes_t zk_im = im[k];
+		const fft_lanes_t zm_re = re[m];
+		const fft_lanes_t zm_im = -im[m];
+		const fft_lanes_t even_re = 0.5f * (zk_re + zm_re);
+		const fft_lanes_t even_im = 0.5f * (zk_im + zm_im);
+		/* -i / 2 * (zk - zm) */
+		const fft_lanes_t odd_re = 0.5f * (zk_im - zm_im);
+		const fft_lanes_t odd_im = -0.5f * (zk_re - zm_re);
+		const fft_lanes_t t_re = w_re * odd_re - w_im * odd_im;
+		const fft_lanes_t t_im = w_re * odd_im + w_im * odd_re;
+
+		re[k] = even_re + t_re;
+		im[k] = even_im + t_im;
+		if (k != m) {
+			re[m] = even_re - t_re;
+			im[m] = -(even_im - t_im);
+		}
 	}
 }
@@ -9,10 +9,71 @@
 
 typedef float complex cplx_t;
 
+typedef struct {
+	size_t n;
+	size_t *bit_reversal; /* Input index of each output position */
+	cplx_t *twiddles; /* exp(-2*pi*i*k/n) for k in [0, n/2[ */
+} fft_plan_t;
+
+/*
+ * Real input fft of n points computed with an n/2 points complex fft.
+ * Only the n/2 + 1 non redundant bins are produced
+ */
+typedef struct {
+	size_t n;
+	fft_plan_t half;
+	cplx_t *twiddles; /* exp(-2*pi*i*k/n) for k in [0, n/4] */
+} rfft_plan_t;
+
+/* Number of windows transformed together by rfft_plan_execute_batch */
+#define FFT_BATCH 8
+
+/* One value per window of a batch, every operation works on all the lanes */
+typedef float fft_lanes_t
+	__attribute__((vector_size(FFT_BATCH * sizeof(float))));
+
+/*
+ * Spectra of FFT_BATCH windows in struct of arrays layout: re[k][w] and
+ * im[k][w] are bin k of window w. Each butterfly then runs on the same bin of
+ * every window at once, filling the SIMD lanes regardless of the fft size
+ */
+typedef struct {
+	fft_lanes_t *re; /* n/2 + 1 bins */
+	fft_lanes_t *im;
+} fft_batch_t;
+
+int fft_plan_init(fft_plan_t *plan, size_t n);
+void fft_plan_execute(const fft_plan_t *plan, cplx_t *buf);
+void fft_plan_terminate(fft_plan_t *plan);
+
+int rfft_plan_init(rfft_plan_t *plan, size_t n);
+/* out must be able to hold n/2 + 1 elements */
+void rfft_plan_execute(const rfft_plan_t *plan, const int16_t *in,
+		       cplx_t *out);
+void rfft_plan_execute_float(const rfft_plan_t *plan, const float *in,
+			     cplx_t *out);
+void rfft_plan_terminate(rfft_plan_t *plan);
+
+int fft_batch_init(fft_batch_t *batch, size_t n);
+/*
+ * Same as rfft_plan_execute on nb_windows <= FFT_BATCH windows of n samples,
+ * the unused lanes are zero filled. The results are only identical when fft.c
+ * is built without floating point contraction
+ */
+void rfft_plan_execute_batch(const rfft_plan_t *plan,
+			     const int16_t *const *in, size_t nb_windows,
+			     fft_batch_t *out);
+void fft_batch_terminate(fft_batch_t *batch);
+
 int fft(cplx_t *buf, size_t n);
 
 void float_to_cplx_t(const int16_t *in, cplx_t *out, size_t n);
+/* Only the first n/2 bins of buf are used, so rfft output can be passed */
 void extract_frequencies(const cplx_t *buf, size_t n, double sample_rate,
 			 uint32_t *f1, uint32_t *f2);
+/* Same as extract_frequencies on the spectrum of one window of a batch */
+void extract_frequencies_batch(const fft_batch_t *batch, size_t window,
+			       size_t n, double sample_rate, uint32_t *f1,
+			       uint32_t *f2);
 
 #endif
@@ -10,6 +10,9 @@
 #include <fcntl.h>
 #include <sys/ioctl.h>
 
+/* Window offsets given to the driver per IOCTL_CORRELATE_WINDOWS */
+#define CORRELATE_BATCH_WINDOWS 256
+
 static int fpga_set_window_samples(fpga_t *fpga, uint32_t window_samples);
 
 int fpga_init(fpga_t *fpga, uint32_t window_samples)
@@ -39,76 +42,138 @@ static int fpga_set_window_samples(fpga_t *fpga, uint32_t window_samples)
 	return ioctl(fpga->fd, IOCTL_SET_WINDOW_SAMPLES, window_samples);
 }
 
-int fpga_calculate_windows(fpga_t *fpga, buffer_t *windows_buffer,
-			   int16_t *signal, int16_t *reference_signals,
-			   uint8_t nb_buttons)
+int fpga_set_signals(fpga_t *fpga, int16_t *signal, int16_t *reference_signals,
+		     size_t nb_references)
 {
 	int err = ioctl(fpga->fd, IOCTL_SET_SIGNAL_ADDR, (long)signal);
 	if (err < 0) {
 		printf("Failed to set signal addr\n");
 		return err;
 	}
+	err = ioctl(fpga->fd, IOCTL_SET_NB_REFERENCES, nb_references);
+	if (err < 0) {
+		printf("Failed to set the number of references (%zu)\n",
+		       nb_references);
+		return err;
+	}
 	err = ioctl(fpga->fd, IOCTL_SET_REF_SIGNAL_ADDR,
 		    (long)reference_signals);
 	if (err < 0) {
-		printf("Failed to set ref signal addr\n");
+		printf("Failed to load the references\n");
+		return err;
+	}
+	/* fpga_correlate reads the results from the first reference on */
+	err = ioctl(fpga->fd, IOCTL_SELECT_REFERENCE, 0);
+	if (err < 0) {
+		printf("Failed to select the first reference\n");
 		return err;
 	}
+	return 0;
+}
 
-	window_t *windows = windows_buffer->data;
-	const size_t len = windows_buffer->len;
+int fpga_set_window(fpga_t *fpga, size_t data_offset)
+{
+	int ret = ioctl(fpga->fd, IOCTL_SET_WINDOW, data_offset);
+	if (ret) {
+		printf("Failed to set window (%d)\n", ret);
+	}
+	return ret;
+}
 
-	for (size_t i = 0; i < len; ++i) {
-		const size_t offset = windows[i].data_offset;
-		int ret = ioctl(fpga->fd, IOCTL_SET_WINDOW, offset);
+int fpga_correlate(fpga_t *fpga, size_t next_offset, size_t nb_references,
+		   uint64_t *dots)
+{
+	/* One calculation correlates the window with every reference */
+	int ret = ioctl(fpga->fd, IOCTL_START_CALCULATION);
+	if (ret) {
+		printf("Failed to start calculation (%d)\n", ret);
+		return ret;
+	}
+	if (next_offset != FPGA_NO_WINDOW) {
+		ret = fpga_set_window(fpga, next_offset);
 		if (ret) {
-			printf("Failed to set window (%d)\n", ret);
 			return ret;
 		}
+	}
 
-		uint64_t best_dot = 0;
-		for (size_t j = 0; j < nb_buttons; ++j) {
-			const size_t ref_offset = j * fpga->window_samples;
+	const size_t len = nb_references * sizeof(*dots);
+	ssize_t bytes = 0;
+	while (true) {
+		bytes = read(fpga->fd, dots, len);
+		if (bytes >= 0) {
+			break;
+		}
+	}
 
-			int ret = ioctl(fpga->fd, IOCTL_SET_REF_WINDOW,
-					ref_offset);
-			if (ret) {
-				printf("Failed to set ref window (%d)\n", ret);
-				return ret;
-			}
+	if (bytes != (ssize_t)len) {
+		printf("Failed to get window results %zd\n", bytes);
+		return -1;
+	}
+	return 0;
+}
 
-			ret = ioctl(fpga->fd, IOCTL_START_CALCULATION,
-				    ref_offset);
-			if (ret) {
-				printf("Failed to start calculation (%d)\n",
-				       ret);
-				return ret;
-			}
+int fpga_calculate_windows(fpga_t *fpga, buffer_t *windows_buffer,
+			   int16_t *signal, size_t signal_samples,
+			   int16_t *reference_signals, uint8_t nb_buttons)
+{
+	int err = fpga_set_signals(fpga, signal, reference_signals, nb_buttons);
+	if (err < 0) {
+		return err;
+	}
 
-			ssize_t bytes = 0;
-			uint64_t dot;
-			while (true) {
-				bytes = read(fpga->fd, &dot, sizeof(dot));
-				if (bytes >= 0) {
-					break;
-				}
-			}
+	window_t *windows = windows_buffer->data;
+	const size_t len = windows_buffer->len;
 
-			if (bytes != sizeof(dot)) {
-				printf("Failed to get window result %zd\n",
-				       bytes);
+	/* The driver keeps the best reference of each window */
+	uint32_t offsets[CORRELATE_BATCH_WINDOWS];
+	uint8_t best[CORRELATE_BATCH_WINDOWS];
+	uint64_t best_dots[CORRELATE_BATCH_WINDOWS];
+	for (size_t i = 0; i < len; i += CORRELATE_BATCH_WINDOWS) {
+		const size_t nb_windows = len - i < CORRELATE_BATCH_WINDOWS ?
+						  len - i :
+						  CORRELATE_BATCH_WINDOWS;
+		for (size_t j = 0; j < nb_windows; ++j) {
+			const size_t offset = windows[i + j].data_offset;
+			/* The driver takes 32 bits offsets of whole windows */
+			if (offset > UINT32_MAX || offset > signal_samples ||
+			    signal_samples - offset < fpga->window_samples) {
+				printf("Window at %zu is past the signal (%zu)\n",
+				       offset, signal_samples);
 				return -1;
 			}
-			if (dot > best_dot) {
-				best_dot = dot;
-				windows[i].button_index = j;
-			}
+			offsets[j] = offset;
+		}
+		struct correlate_windows args = {
+			.offsets = (uintptr_t)offsets,
+			.nb_windows = nb_windows,
+			.nb_references = nb_buttons,
+			.best = (uintptr_t)best,
+			.best_dots = (uintptr_t)best_dots,
+			.signal_samples = signal_samples,
+		};
+		int ret = ioctl(fpga->fd, IOCTL_CORRELATE_WINDOWS, &args);
+		if (ret) {
+			printf("Failed to correlate windows (%d)\n", ret);
+			return ret;
+		}
+		for (size_t j = 0; j < nb_windows; ++j) {
+			windows[i + j].button_index =
+				fpga_button_index(best[j], nb_buttons);
 		}
 	}
 
 	return 0;
 }
 
+uint8_t fpga_button_index(uint8_t best, size_t nb_buttons)
+{
+	/* All the dot products are 0, e.g. on a window of zeros */
+	if (best == CORRELATE_NO_REFERENCE || best >= nb_buttons) {
+		return WINDOW_NO_BUTTON;
+	}
+	return best;
+}
+
 void fpga_terminate(fpga_t *fpga)
 {
 	close(fpga->fd);
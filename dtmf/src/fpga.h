@@ -12,9 +12,38 @@ typedef struct {
 } fpga_t;
 
 int fpga_init(fpga_t *fpga, uint32_t window_size);
+/*
+ * The signal stays in user memory, the driver reads it on each window. The
+ * nb_references reference windows, each window_samples long, are loaded once
+ * in the reference bank of the FPGA
+ */
+int fpga_set_signals(fpga_t *fpga, int16_t *signal, int16_t *reference_signals,
+		     size_t nb_references);
+/* next_offset of fpga_correlate when there is no next window */
+#define FPGA_NO_WINDOW SIZE_MAX
+
+/* Sets the window at data_offset, the one the next fpga_correlate uses */
+int fpga_set_window(fpga_t *fpga, size_t data_offset);
+/*
+ * Correlates the window set last with the first nb_references loaded, one
+ * start and one read of all the dot products. The window at next_offset is
+ * set while the FPGA calculates, the FPGA has a window bank for each
+ */
+int fpga_correlate(fpga_t *fpga, size_t next_offset, size_t nb_references,
+		   uint64_t *dots);
+/*
+ * Sets the button_index of each window to its best matching reference, the
+ * FPGA picks it and the driver handles a whole batch of windows per call.
+ * Fails before any call when a window doesn't end inside the signal_samples
+ */
 int fpga_calculate_windows(fpga_t *fpga, buffer_t *windows_buffer,
-			   int16_t *signal, int16_t *reference_signals,
-			   uint8_t nb_buttons);
+			   int16_t *signal, size_t signal_samples,
+			   int16_t *reference_signals, uint8_t nb_buttons);
+/*
+ * button_index of a window whose best reference is best, WINDOW_NO_BUTTON when
+ * the device found none (CORRELATE_NO_REFERENCE)
+ */
+uint8_t fpga_button_index(uint8_t best, size_t nb_buttons);
 void fpga_terminate(fpga_t *fpga);
 
 #endif
@@ -0,0 +1,37 @@
+#include "goertzel.h"
+#include <math.h>
+
+/*
+ * Source: https://en.wikipedia.org/wiki/Goertzel_algorithm
+ * The coefficient does not need to be on an FFT bin so we can evaluate the
+ * exact DTMF frequencies
+ */
+float goertzel_coeff(uint32_t freq, uint32_t sample_rate)
+{
+	return 2.f * cosf(2.f * (float)M_PI * freq / sample_rate);
+}
+
+/*
+ * Returns |X(f)|^2 for the frequency described by coeff
+ */
+float goertzel_power(const int16_t *signal, size_t len, float coeff)
+{
+	float s1 = 0.f;
+	float s2 = 0.f;
+
+	for (size_t i = 0; i < len; ++i) {
+		const float s0 = signal[i] + coeff * s1 - s2;
+		s2 = s1;
+		s1 = s0;
+	}
+	return s1 * s1 + s2 * s2 - coeff * s1 * s2;
+}
+
+double signal_energy(const int16_t *signal, size_t len)
+{
+	double energy = 0;
+	for (size_t i = 0; i < len; ++i) {
+		energy += (double)signal[i] * signal[i];
+	}
+	return energy;
+}
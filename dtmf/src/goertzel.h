@@ -0,0 +1,10 @@
+#ifndef GOERTZEL_H
+#define GOERTZEL_H
+#include <stddef.h>
+#include <stdint.h>
+
+float goertzel_coeff(uint32_t freq, uint32_t sample_rate);
+float goertzel_power(const int16_t *signal, size_t len, float coeff);
+double signal_energy(const int16_t *signal, size_t len);
+
+#endif
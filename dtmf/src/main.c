@@ -1,3 +1,4 @@
+#include "batch.h"
 #include "buffer.h"
 #include "dtmf.h"
 #include "file.h"
@@ -6,38 +7,85 @@
 #include <time.h>
 #include <stdio.h>
 #include <string.h>
+#include <unistd.h>
 
-typedef char *(*dtmf_decode_fn)(dtmf_t *);
+#define STREAM_CHUNK_MS 20
+
+typedef char *(*dtmf_decode_fn)(dtmf_decoder_ctx_t *, dtmf_t *);
 void print_usage(const char *prog)
 {
 	printf("Usage :\n"
 	       "\t%s encode input.txt output.wav\n"
-	       "\t%s decode input.wav\n"
-	       "\t%s decode_time_domain input.wav\n"
-	       "\t%s decode_fpga input.wav\n",
-	       prog, prog, prog, prog);
+	       "\t%s decode input.wav [--threads N]\n"
+	       "\t%s decode_time_domain input.wav [--threads N]\n"
+	       "\t%s decode_time_domain_combined input.wav [--threads N]\n"
+	       "\t%s decode_goertzel input.wav [--threads N]\n"
+	       "\t%s decode_sliding input.wav\n"
+	       "\t%s decode_stream input.wav [--sliding]\n"
+	       "\t%s decode_channels input.wav\n"
+	       "\t%s decode_batch list.txt|directory [--threads N]\n"
+	       "\t%s decode_fpga input.wav\n"
+	       "\t%s decode_fpga_separable input.wav\n",
+	       prog, prog, prog, prog, prog, prog, prog, prog, prog, prog,
+	       prog);
 }
 
-int decode(const char *wave_file, dtmf_decode_fn decode_fn)
+/*
+ * Parses the optional "--threads N" following the input file, nb_threads is
+ * left untouched without it
+ */
+static int parse_threads(int argc, char *argv[], size_t *nb_threads)
+{
+	if (argc == 3) {
+		return 0;
+	}
+	if (argc != 5 || strcmp(argv[3], "--threads") != 0) {
+		return -1;
+	}
+	char *end;
+	const long value = strtol(argv[4], &end, 10);
+	if (*end != '\0' || value < 1) {
+		printf("Invalid thread count %s\n", argv[4]);
+		return -1;
+	}
+	*nb_threads = (size_t)value;
+	return 0;
+}
+
+int decode(const char *wave_file, dtmf_decode_fn decode_fn,
+	   dtmf_decode_mode_t mode, size_t nb_threads)
 {
 	dtmf_t decoder;
-	double sample_rate;
-	size_t len;
-	int16_t *data = wave_read(wave_file, &len, &sample_rate);
-	if (!data) {
+	wave_t wave;
+	if (wave_open(&wave, wave_file) < 0) {
 		return EXIT_FAILURE;
 	}
 
-	buffer_construct(&decoder.buffer, data, len, len, sizeof(*data));
-	decoder.sample_rate = sample_rate;
-	decoder.channels = 1;
+	/* The samples stay owned by the wave, no copy needed */
+	buffer_construct_view(&decoder.buffer, wave.samples, wave.len,
+			      sizeof(*wave.samples));
+	decoder.sample_rate = wave.sample_rate;
+	decoder.channels = wave.channels;
+
+	dtmf_decoder_ctx_t *ctx = dtmf_decoder_ctx_create(decoder.sample_rate);
+	if (!ctx) {
+		printf("Failed to create decoder context\n");
+		dtmf_terminate(&decoder);
+		wave_close(&wave);
+		return EXIT_FAILURE;
+	}
 
 	clock_t t;
 	t = clock();
-	char *value = decode_fn(&decoder);
+	char *value = nb_threads > 1 ? dtmf_decode_parallel(ctx, &decoder, mode,
+							    nb_threads) :
+				       decode_fn(ctx, &decoder);
 	t = clock() - t;
+	dtmf_decoder_ctx_terminate(ctx);
 	if (!value) {
 		printf("Failed to decode\n");
+		dtmf_terminate(&decoder);
+		wave_close(&wave);
 		return EXIT_FAILURE;
 	}
 	const double time_taken = ((double)t) / CLOCKS_PER_SEC;
@@ -45,10 +93,116 @@ int decode(const char *wave_file, dtmf_decode_fn decode_fn)
 
 	printf("Decoded: %s\n", value);
 
+	free(value);
+	dtmf_terminate(&decoder);
+	wave_close(&wave);
+	return EXIT_SUCCESS;
+}
+
+/* Decodes every channel of an interleaved file, one value per channel */
+int decode_channels(const char *wave_file)
+{
+	dtmf_t decoder;
+	wave_t wave;
+	if (wave_open(&wave, wave_file) < 0) {
+		return EXIT_FAILURE;
+	}
+
+	buffer_construct_view(&decoder.buffer, wave.samples, wave.len,
+			      sizeof(*wave.samples));
+	decoder.sample_rate = wave.sample_rate;
+	decoder.channels = wave.channels;
+
+	dtmf_decoder_ctx_t *ctx = dtmf_decoder_ctx_create(decoder.sample_rate);
+	if (!ctx) {
+		printf("Failed to create decoder context\n");
+		dtmf_terminate(&decoder);
+		wave_close(&wave);
+		return EXIT_FAILURE;
+	}
+
+	clock_t t;
+	t = clock();
+	char **values = dtmf_decode_channels(ctx, &decoder);
+	t = clock() - t;
+	dtmf_decoder_ctx_terminate(ctx);
+	if (!values) {
+		printf("Failed to decode\n");
+		dtmf_terminate(&decoder);
+		wave_close(&wave);
+		return EXIT_FAILURE;
+	}
+	const double time_taken = ((double)t) / CLOCKS_PER_SEC;
+	printf("Decoding alone took %g seconds\n", time_taken);
+
+	for (uint32_t i = 0; i < decoder.channels; ++i) {
+		printf("Channel %u decoded: %s\n", i, values[i]);
+		free(values[i]);
+	}
+	free(values);
 	dtmf_terminate(&decoder);
+	wave_close(&wave);
 	return EXIT_SUCCESS;
 }
 
+static void print_char(char c, void *user_data)
+{
+	(void)user_data;
+	putchar(c);
+	fflush(stdout);
+}
+
+/*
+ * Feeds the file to the streaming decoder in small chunks, the way a live
+ * line would, and prints each character as soon as it is confirmed
+ */
+int decode_stream(const char *wave_file, dtmf_decode_mode_t mode)
+{
+	wave_t wave;
+	if (wave_open(&wave, wave_file) < 0) {
+		return EXIT_FAILURE;
+	}
+	if (wave.channels != 1) {
+		printf("Streaming takes mono files, use decode_channels\n");
+		wave_close(&wave);
+		return EXIT_FAILURE;
+	}
+	const int16_t *data = wave.samples;
+	const size_t len = wave.len;
+
+	dtmf_decoder_ctx_t *ctx = dtmf_decoder_ctx_create(wave.sample_rate);
+	dtmf_decoder_t *decoder =
+		ctx ? dtmf_decoder_create(ctx, mode, print_char, NULL) :
+		      NULL;
+	if (!decoder) {
+		printf("Failed to create decoder\n");
+		dtmf_decoder_ctx_terminate(ctx);
+		wave_close(&wave);
+		return EXIT_FAILURE;
+	}
+
+	const size_t chunk = STREAM_CHUNK_MS * wave.sample_rate / 1000;
+	int ret = EXIT_SUCCESS;
+	printf("Decoded: ");
+	for (size_t i = 0; i < len; i += chunk) {
+		const size_t n = len - i < chunk ? len - i : chunk;
+		if (dtmf_decoder_feed(decoder, data + i, n) < 0) {
+			printf("\nFailed to decode\n");
+			ret = EXIT_FAILURE;
+			break;
+		}
+	}
+	if (ret == EXIT_SUCCESS) {
+		dtmf_decoder_finish(decoder);
+		putchar('\n');
+	}
+
+	dtmf_decoder_terminate(decoder);
+	dtmf_decoder_ctx_terminate(ctx);
+	wave_close(&wave);
+	return ret;
+}
+
 int main(int argc, char *argv[])
 {
 	if (argc < 3) {
@@ -85,12 +239,65 @@ int main(int argc, char *argv[])
 		dtmf_terminate(&encoder);
 		return err != 0;
 
-	} else if (strcmp(argv[1], "decode") == 0) {
-		return decode(argv[2], dtmf_decode);
+	}
+
+	size_t nb_threads = 1;
+	if (strcmp(argv[1], "decode_batch") == 0) {
+		const long nb_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+		nb_threads = nb_cpus > 0 ? (size_t)nb_cpus : 1;
+	}
+	if (strcmp(argv[1], "decode") == 0 ||
+	    strcmp(argv[1], "decode_time_domain") == 0 ||
+	    strcmp(argv[1], "decode_time_domain_combined") == 0 ||
+	    strcmp(argv[1], "decode_goertzel") == 0 ||
+	    strcmp(argv[1], "decode_batch") == 0) {
+		if (parse_threads(argc, argv, &nb_threads) < 0) {
+			print_usage(argv[0]);
+			return 1;
+		}
+	}
+
+	if (strcmp(argv[1], "decode") == 0) {
+		return decode(argv[2], dtmf_decode,
+			      DTMF_DECODE_FREQUENCY_DOMAIN, nb_threads);
 	} else if (strcmp(argv[1], "decode_time_domain") == 0) {
-		return decode(argv[2], dtmf_decode_time_domain);
+		return decode(argv[2], dtmf_decode_time_domain,
+			      DTMF_DECODE_TIME_DOMAIN, nb_threads);
+	} else if (strcmp(argv[1], "decode_time_domain_combined") == 0) {
+		return decode(argv[2], dtmf_decode_time_domain_combined,
+			      DTMF_DECODE_TIME_DOMAIN_COMBINED, nb_threads);
+	} else if (strcmp(argv[1], "decode_goertzel") == 0) {
+		return decode(argv[2], dtmf_decode_goertzel,
+			      DTMF_DECODE_GOERTZEL, nb_threads);
+	} else if (strcmp(argv[1], "decode_sliding") == 0) {
+		return decode(argv[2], dtmf_decode_sliding, DTMF_DECODE_SLIDING,
+			      1);
+	} else if (strcmp(argv[1], "decode_stream") == 0) {
+		if (argc == 4 && strcmp(argv[3], "--sliding") == 0) {
+			return decode_stream(argv[2], DTMF_DECODE_SLIDING);
+		}
+		if (argc != 3) {
+			print_usage(argv[0]);
+			return 1;
+		}
+		return decode_stream(argv[2], DTMF_DECODE_FREQUENCY_DOMAIN);
+	} else if (strcmp(argv[1], "decode_channels") == 0) {
+		if (argc != 3) {
+			print_usage(argv[0]);
+			return 1;
+		}
+		return decode_channels(argv[2]);
+	} else if (strcmp(argv[1], "decode_batch") == 0) {
+		return batch_decode(argv[2], DTMF_DECODE_FREQUENCY_DOMAIN,
+				    nb_threads) < 0 ?
+			       EXIT_FAILURE :
+			       EXIT_SUCCESS;
 	} else if (strcmp(argv[1], "decode_fpga") == 0) {
-		return decode(argv[2], dtmf_decode_fpga);
+		return decode(argv[2], dtmf_decode_fpga,
+			      DTMF_DECODE_FREQUENCY_DOMAIN, 1);
+	} else if (strcmp(argv[1], "decode_fpga_separable") == 0) {
+		return decode(argv[2], dtmf_decode_fpga_separable,
+			      DTMF_DECODE_FREQUENCY_DOMAIN, 1);
 	} else {
 		print_usage(argv[0]);
 		return 1;
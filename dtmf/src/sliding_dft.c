@@ -0,0 +1,119 @@
+#include "sliding_dft.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Twiddles are scaled by 2^TWIDDLE_SHIFT */
+#define TWIDDLE_SHIFT 14
+
+int sliding_dft_init(sliding_dft_t *sdft, size_t len, const uint32_t *bins,
+		     size_t nb_bins, size_t nb_channels)
+{
+	if (len == 0 || nb_channels == 0 || nb_bins > SLIDING_DFT_MAX_BINS) {
+		printf("Invalid sliding dft of %zu bins over %zu samples\n",
+		       nb_bins, len);
+		return -1;
+	}
+	memset(sdft, 0, sizeof(*sdft));
+	const size_t nb_values = nb_bins * nb_channels;
+	sdft->re = malloc(nb_values * sizeof(*sdft->re));
+	sdft->im = malloc(nb_values * sizeof(*sdft->im));
+	sdft->energy = malloc(nb_channels * sizeof(*sdft->energy));
+	sdft->delta = malloc(nb_channels * sizeof(*sdft->delta));
+	sdft->cos_table = malloc(len * sizeof(*sdft->cos_table));
+	sdft->sin_table = malloc(len * sizeof(*sdft->sin_table));
+	sdft->history = malloc(len * nb_channels * sizeof(*sdft->history));
+	if (!sdft->re || !sdft->im || !sdft->energy || !sdft->delta ||
+	    !sdft->cos_table || !sdft->sin_table || !sdft->history) {
+		sliding_dft_terminate(sdft);
+		return -1;
+	}
+	sdft->len = len;
+	sdft->nb_bins = nb_bins;
+	sdft->nb_channels = nb_channels;
+
+	for (size_t i = 0; i < len; ++i) {
+		const double angle = 2. * M_PI * i / len;
+		sdft->cos_table[i] = lround(cos(angle) * (1 << TWIDDLE_SHIFT));
+		sdft->sin_table[i] = lround(sin(angle) * (1 << TWIDDLE_SHIFT));
+	}
+	for (size_t i = 0; i < nb_bins; ++i) {
+		sdft->bins[i] = bins[i] % len;
+	}
+	sliding_dft_reset(sdft);
+	return 0;
+}
+
+void sliding_dft_push(sliding_dft_t *sdft, const int16_t *frame)
+{
+	const size_t nb_channels = sdft->nb_channels;
+	int16_t *oldest = sdft->history + sdft->head * nb_channels;
+	int32_t *delta = sdft->delta;
+
+	for (size_t c = 0; c < nb_channels; ++c) {
+		delta[c] = (int32_t)frame[c] - oldest[c];
+		sdft->energy[c] += (int32_t)frame[c] * frame[c] -
+				   (int32_t)oldest[c] * oldest[c];
+		oldest[c] = frame[c];
+	}
+	sdft->head = sdft->head + 1 == sdft->len ? 0 : sdft->head + 1;
+
+	for (size_t i = 0; i < sdft->nb_bins; ++i) {
+		const uint32_t phase = sdft->phases[i];
+		const int64_t cos_w = sdft->cos_table[phase];
+		const int64_t sin_w = sdft->sin_table[phase];
+		int64_t *re = sdft->re + i * nb_channels;
+		int64_t *im = sdft->im + i * nb_channels;
+		for (size_t c = 0; c < nb_channels; ++c) {
+			re[c] += delta[c] * cos_w;
+			im[c] -= delta[c] * sin_w;
+		}
+
+		const uint32_t next = phase + sdft->bins[i];
+		sdft->phases[i] = next >= sdft->len ? next - sdft->len : next;
+	}
+}
+
+void sliding_dft_powers(const sliding_dft_t *sdft, size_t bin, double *powers)
+{
+	const double scale = 1. / (1 << TWIDDLE_SHIFT);
+	const int64_t *re = sdft->re + bin * sdft->nb_channels;
+	const int64_t *im = sdft->im + bin * sdft->nb_channels;
+
+	for (size_t c = 0; c < sdft->nb_channels; ++c) {
+		const double r = re[c] * scale;
+		const double i = im[c] * scale;
+		powers[c] = r * r + i * i;
+	}
+}
+
+void sliding_dft_reset(sliding_dft_t *sdft)
+{
+	const size_t nb_values = sdft->nb_bins * sdft->nb_channels;
+	memset(sdft->history, 0,
+	       sdft->len * sdft->nb_channels * sizeof(*sdft->history));
+	memset(sdft->phases, 0, sizeof(sdft->phases));
+	memset(sdft->re, 0, nb_values * sizeof(*sdft->re));
+	memset(sdft->im, 0, nb_values * sizeof(*sdft->im));
+	memset(sdft->energy, 0, sdft->nb_channels * sizeof(*sdft->energy));
+	sdft->head = 0;
+}
+
+void sliding_dft_terminate(sliding_dft_t *sdft)
+{
+	free(sdft->re);
+	free(sdft->im);
+	free(sdft->energy);
+	free(sdft->delta);
+	free(sdft->cos_table);
+	free(sdft->sin_table);
+	free(sdft->history);
+	sdft->re = NULL;
+	sdft->im = NULL;
+	sdft->energy = NULL;
+	sdft->delta = NULL;
+	sdft->cos_table = NULL;
+	sdft->sin_table = NULL;
+	sdft->history = NULL;
+}
@@ -0,0 +1,47 @@
+#ifndef SLIDING_DFT_H
+#define SLIDING_DFT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define SLIDING_DFT_MAX_BINS 8
+
+/*
+ * DFT of the last len frames on a few bins, updated in O(nb_bins) for each
+ * new frame. Bin k accumulates x[m] * exp(-2*pi*i*k*m/len) over absolute
+ * sample indexes m: the sample leaving the window has the same twiddle as the
+ * one entering it, so an update is one multiply-add of their difference. The
+ * twiddles are Q14 integers and the sums are exact, nothing drifts however
+ * long the stream.
+ *
+ * Every channel of a frame shares the twiddles, the per channel values are
+ * stored [bin][channel] so each update is a loop over contiguous channels.
+ */
+typedef struct {
+	size_t len;
+	size_t nb_bins;
+	size_t nb_channels;
+	uint32_t bins[SLIDING_DFT_MAX_BINS];
+	uint32_t phases[SLIDING_DFT_MAX_BINS]; /* k * n modulo len */
+	int64_t *re; /* nb_bins * nb_channels */
+	int64_t *im;
+	int64_t *energy; /* Sum of the squared samples of each channel */
+	int32_t *delta; /* Per channel scratch of sliding_dft_push */
+	int32_t *cos_table; /* len entries */
+	int32_t *sin_table;
+	int16_t *history; /* Ring of the last len frames */
+	size_t head;
+} sliding_dft_t;
+
+/* Bins are given as k in [0, len[, the frequency being k * sample_rate / len */
+int sliding_dft_init(sliding_dft_t *sdft, size_t len, const uint32_t *bins,
+		     size_t nb_bins, size_t nb_channels);
+/* frame holds one sample of each channel */
+void sliding_dft_push(sliding_dft_t *sdft, const int16_t *frame);
+/* |X[k]|^2 of the bin for every channel, same scale as a goertzel power */
+void sliding_dft_powers(const sliding_dft_t *sdft, size_t bin, double *powers);
+/* Back to an empty (all zero) window */
+void sliding_dft_reset(sliding_dft_t *sdft);
+void sliding_dft_terminate(sliding_dft_t *sdft);
+
+#endif
@@ -5,6 +5,7 @@
 #include <stdbool.h>
 
 #define ARRAY_LEN(arr) (sizeof(arr) / sizeof(arr[0]))
+#define MIN(a, b)	((a) < (b) ? (a) : (b))
 
 size_t align_to_power_of_2(size_t n);
 bool is_power_of_2(size_t n);
@@ -2,8 +2,27 @@
 #include "wave.h"
 //#include <sndfile-64.h>
 #include <sndfile.h>
+#include <fcntl.h>
+#include <stdbool.h>
 #include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define WAVE_FORMAT_PCM	       0x0001
+#define WAVE_FORMAT_EXTENSIBLE 0xFFFE
+#define RIFF_HEADER_SIZE       12
+#define CHUNK_HEADER_SIZE      8
+#define FMT_CHUNK_MIN_SIZE     16
+/* Offset of the sub format GUID's first two bytes in an extensible fmt chunk */
+#define FMT_EXTENSIBLE_SUBFORMAT_OFFSET 24
+
+static int wave_map(wave_t *wave, const char *path);
+static bool parse_canonical_pcm16(const uint8_t *file, size_t file_len,
+				  size_t *data_offset, size_t *data_len,
+				  uint32_t *sample_rate, uint32_t *channels);
 
 int wave_generate(const char *path, int16_t *buffer, size_t len,
 		  uint32_t channels, uint32_t sample_rate)
@@ -25,13 +44,14 @@ int wave_generate(const char *path, int16_t *buffer, size_t len,
 	return 0;
 }
 
-int16_t *wave_read(const char *path, size_t *len, double *sample_rate)
+int16_t *wave_read(const char *path, size_t *len, double *sample_rate,
+		   uint32_t *channels)
 {
 	SF_INFO sfinfo;
 	SNDFILE *infile = sf_open(path, SFM_READ, &sfinfo);
 	if (!infile) {
-		printf("Error opening wave file (%s): %s\n", path,
-		       sf_strerror(NULL));
+		fprintf(stderr, "Error opening wave file (%s): %s\n", path,
+			sf_strerror(NULL));
 		return NULL;
 	}
 
@@ -41,7 +61,8 @@ int16_t *wave_read(const char *path, size_t *len, double *sample_rate)
 		   sizeof(format_info));
 	int subformat = sfinfo.format & SF_FORMAT_SUBMASK;
 	if (subformat != SF_FORMAT_PCM_16) {
-		printf("Invalid wave file format %#x \n", subformat);
+		fprintf(stderr, "Invalid wave file format %#x \n", subformat);
+		sf_close(infile);
 		return NULL;
 	}
 #if 0
@@ -55,11 +76,13 @@ int16_t *wave_read(const char *path, size_t *len, double *sample_rate)
 	       (double)sfinfo.frames / sfinfo.samplerate);
 #endif
 
-	*len = sfinfo.frames;
+	*len = sfinfo.frames * sfinfo.channels;
 	*sample_rate = sfinfo.samplerate;
+	*channels = sfinfo.channels;
 
 	if ((sfinfo.format & SF_FORMAT_TYPEMASK) != SF_FORMAT_WAV) {
-		printf("Error. The file (%s) is not in wave format\n", path);
+		fprintf(stderr, "Error. The file (%s) is not in wave format\n",
+			path);
 		sf_close(infile);
 		return NULL;
 	}
@@ -72,7 +95,7 @@ int16_t *wave_read(const char *path, size_t *len, double *sample_rate)
 		return NULL;
 	}
 
-	sf_count_t frames_read = sf_read_short(infile, buffer, sfinfo.frames);
+	sf_count_t frames_read = sf_readf_short(infile, buffer, sfinfo.frames);
 	if (frames_read != sfinfo.frames) {
 		fprintf(stderr,
 			"Avertissement: Seuls %lld frames sur %lld ont été lus.\n",
@@ -82,3 +105,150 @@ int16_t *wave_read(const char *path, size_t *len, double *sample_rate)
 	sf_close(infile);
 	return buffer;
 }
+
+int wave_open(wave_t *wave, const char *path)
+{
+	memset(wave, 0, sizeof(*wave));
+	if (wave_map(wave, path) == 0) {
+		return 0;
+	}
+
+	size_t len;
+	double sample_rate;
+	uint32_t channels;
+	int16_t *samples = wave_read(path, &len, &sample_rate, &channels);
+	if (!samples) {
+		return -1;
+	}
+	wave->samples = samples;
+	wave->len = len;
+	wave->sample_rate = sample_rate;
+	wave->channels = channels;
+	return 0;
+}
+
+void wave_close(wave_t *wave)
+{
+	if (wave->map) {
+		munmap(wave->map, wave->map_len);
+	} else {
+		free((void *)wave->samples);
+	}
+	memset(wave, 0, sizeof(*wave));
+}
+
+static int wave_map(wave_t *wave, const char *path)
+{
+#if __BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__
+	(void)wave;
+	(void)path;
+	return -1;
+#else
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		return -1;
+	}
+	struct stat st;
+	if (fstat(fd, &st) < 0 || st.st_size < RIFF_HEADER_SIZE) {
+		close(fd);
+		return -1;
+	}
+
+	const size_t map_len = st.st_size;
+	void *map = mmap(NULL, map_len, PROT_READ, MAP_PRIVATE, fd, 0);
+	/* The mapping stays valid once the file is closed */
+	close(fd);
+	if (map == MAP_FAILED) {
+		return -1;
+	}
+
+	size_t data_offset, data_len;
+	uint32_t sample_rate, channels;
+	if (!parse_canonical_pcm16(map, map_len, &data_offset, &data_len,
+				   &sample_rate, &channels)) {
+		munmap(map, map_len);
+		return -1;
+	}
+	madvise(map, map_len, MADV_SEQUENTIAL);
+
+	wave->samples = (const int16_t *)((const uint8_t *)map + data_offset);
+	/* A truncated last frame is dropped */
+	wave->len = data_len / (sizeof(int16_t) * channels) * channels;
+	wave->sample_rate = sample_rate;
+	wave->channels = channels;
+	wave->map = map;
+	wave->map_len = map_len;
+	return 0;
+#endif
+}
+
+static uint16_t read_le16(const uint8_t *p)
+{
+	return p[0] | (p[1] << 8);
+}
+
+static uint32_t read_le32(const uint8_t *p)
+{
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+/*
+ * Walks the RIFF chunks looking for a 16 bits PCM "fmt " chunk followed
+ * by the "data" chunk
+ * Source: http://soundfile.sapp.org/doc/WaveFormat/
+ */
+static bool parse_canonical_pcm16(const uint8_t *file, size_t file_len,
+				  size_t *data_offset, size_t *data_len,
+				  uint32_t *sample_rate, uint32_t *channels)
+{
+	if (memcmp(file, "RIFF", 4) != 0 || memcmp(file + 8, "WAVE", 4) != 0) {
+		return false;
+	}
+
+	bool found_fmt = false;
+	size_t offset = RIFF_HEADER_SIZE;
+	while (offset + CHUNK_HEADER_SIZE <= file_len) {
+		const uint8_t *chunk = file + offset;
+		const size_t chunk_len = read_le32(chunk + 4);
+		const uint8_t *body = chunk + CHUNK_HEADER_SIZE;
+		const size_t available = file_len - offset - CHUNK_HEADER_SIZE;
+
+		if (memcmp(chunk, "fmt ", 4) == 0) {
+			if (chunk_len < FMT_CHUNK_MIN_SIZE ||
+			    chunk_len > available) {
+				return false;
+			}
+			uint16_t format = read_le16(body);
+			if (format == WAVE_FORMAT_EXTENSIBLE &&
+			    chunk_len >= FMT_EXTENSIBLE_SUBFORMAT_OFFSET + 2) {
+				format = read_le16(
+					body + FMT_EXTENSIBLE_SUBFORMAT_OFFSET);
+			}
+			const uint16_t nb_channels = read_le16(body + 2);
+			const uint16_t bits_per_sample = read_le16(body + 14);
+			if (format != WAVE_FORMAT_PCM || nb_channels == 0 ||
+			    bits_per_sample != 16) {
+				return false;
+			}
+			*sample_rate = read_le32(body + 4);
+			*channels = nb_channels;
+			found_fmt = true;
+		} else if (memcmp(chunk, "data", 4) == 0) {
+			if (!found_fmt) {
+				return false;
+			}
+			*data_offset = offset + CHUNK_HEADER_SIZE;
+			/* Truncated recordings: only use what is there */
+			*data_len = chunk_len < available ? chunk_len :
+							    available;
+			/* Chunks are word aligned so samples are too */
+			return (*data_offset % sizeof(int16_t)) == 0;
+		}
+		if (chunk_len > available) {
+			return false;
+		}
+		/* Chunks are padded to an even size */
+		offset += CHUNK_HEADER_SIZE + chunk_len + (chunk_len & 1);
+	}
+	return false;
+}
@@ -8,6 +8,26 @@
 int wave_generate(const char *path, int16_t *buffer, size_t len,
 		  uint32_t channels, uint32_t sample_rate);
 
-int16_t *wave_read(const char *path, size_t *len, double *sample_rate);
+typedef struct {
+	/* Interleaved, one sample of each channel per frame */
+	const int16_t *samples;
+	size_t len; /* Samples of all the channels, frames * channels */
+	double sample_rate;
+	uint32_t channels;
+	/* Set when samples point into a mapping of the file */
+	void *map;
+	size_t map_len;
+} wave_t;
+
+/* len is set to frames * channels, the samples stay interleaved */
+int16_t *wave_read(const char *path, size_t *len, double *sample_rate,
+		   uint32_t *channels);
+
+/*
+ * Maps canonical PCM16 little endian files and points samples straight
+ * into the mapping. Anything else is read with libsndfile into memory.
+ */
+int wave_open(wave_t *wave, const char *path);
+void wave_close(wave_t *wave);
 
 #endif
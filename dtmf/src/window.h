@@ -1,14 +1,19 @@
 #ifndef WINDOW_H
 #define WINDOW_H
 
+#include "buffer.h"
 #include <stddef.h>
 #include <stdint.h>
 #include <stdbool.h>
 
+#define WINDOW_NO_BUTTON 0xff
+
 typedef struct {
 	size_t data_offset;
-	uint8_t button_index;
-	bool silence_detected_after;
+	uint8_t button_index; /* WINDOW_NO_BUTTON until classified */
+	uint32_t silences_after; /* Silent windows skipped after this one */
 } window_t;
 
+BUFFER_DEFINE_TYPED_PUSH(window, window_t)
+
 #endif
@@ -0,0 +1,83 @@
+/*
+ * Checks that every dot product kernel supported by this CPU gives the exact
+ * same result as the scalar reference
+ */
+#include "dot_product.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define MAX_LEN	   257
+#define NB_ROUNDS  2000
+
+/* Kernels only guarantee exact results if y doesn't contain INT16_MIN */
+static int16_t random_sample(bool allow_min)
+{
+	const int32_t value = (rand() % 65536) - 32768;
+	if (!allow_min && value == INT16_MIN) {
+		return INT16_MIN + 1;
+	}
+	return value;
+}
+
+static bool check(const dot_product_kernel_t *kernel, const int16_t *x,
+		  const int16_t *y, size_t len)
+{
+	const uint64_t expected = dot_product_scalar(x, y, len);
+	const uint64_t got = kernel->fn(x, y, len);
+	if (got != expected) {
+		printf("%s: len %zu expected %llu but got %llu\n", kernel->name,
+		       len, (unsigned long long)expected,
+		       (unsigned long long)got);
+		return false;
+	}
+	return true;
+}
+
+int main(void)
+{
+	const dot_product_kernel_t *kernels;
+	const size_t nb_kernels = dot_product_get_kernels(&kernels);
+	int16_t x[MAX_LEN + 1];
+	int16_t y[MAX_LEN + 1];
+	bool ok = true;
+
+	printf("Selected kernel: %s\n", dot_product_kernel_name());
+
+	srand(42);
+	for (size_t k = 0; k < nb_kernels; ++k) {
+		const dot_product_kernel_t *kernel = &kernels[k];
+		bool kernel_ok = true;
+
+		for (size_t round = 0; round < NB_ROUNDS; ++round) {
+			const size_t len = round % (MAX_LEN + 1);
+			for (size_t i = 0; i < len + 1; ++i) {
+				x[i] = random_sample(true);
+				y[i] = random_sample(false);
+			}
+			/* Unaligned pointers on odd rounds */
+			const size_t offset = round & 1;
+			kernel_ok &= check(kernel, x + offset, y + offset,
+					   len - (offset && len ? 1 : 0));
+		}
+
+		/* Worst case magnitudes */
+		for (size_t i = 0; i < MAX_LEN; ++i) {
+			x[i] = INT16_MIN;
+			y[i] = INT16_MAX;
+		}
+		kernel_ok &= check(kernel, x, y, MAX_LEN);
+		for (size_t i = 0; i < MAX_LEN; ++i) {
+			x[i] = INT16_MIN;
+			y[i] = INT16_MIN + 1;
+		}
+		kernel_ok &= check(kernel, x, y, MAX_LEN);
+
+		printf("%-8s %s\n", kernel->name, kernel_ok ? "OK" : "KO");
+		ok &= kernel_ok;
+	}
+
+	return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,125 @@
+/*
+ * Checks the windows the FPGA decoder gets back from the device: the best
+ * reference is picked like correlation.vhd does, so a window of zeros has
+ * none (CORRELATE_NO_REFERENCE), and it must decode as noise instead of a
+ * button
+ */
+#include "access.h"
+#include "dot_product.h"
+#include "dtmf.h"
+#include "dtmf_private.h"
+#include "fpga.h"
+#include "utils.h"
+#include "window.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Button 1 is "2abc" */
+#define PRESSED_BUTTON	 1
+#define PRESSED_MESSAGE	 "2"
+/* Presses of PRESSED_BUTTON in windows[] below, then one more */
+#define EXPECTED_MESSAGE "b2"
+
+/* Strictly greater from the first reference on, lowest index on ties */
+static uint8_t best_reference(const int16_t *window, const int16_t *references,
+			      size_t nb_references, size_t len)
+{
+	uint8_t best = CORRELATE_NO_REFERENCE;
+	uint64_t best_dot = 0;
+	for (size_t j = 0; j < nb_references; ++j) {
+		const uint64_t dot =
+			dot_product(window, references + j * len, len);
+		if (dot > best_dot) {
+			best_dot = dot;
+			best = j;
+		}
+	}
+	return best;
+}
+
+int main(void)
+{
+	dtmf_t dtmf;
+	if (dtmf_encode(&dtmf, PRESSED_MESSAGE) != DTMF_OK) {
+		printf("Failed to encode the message\n");
+		return 1;
+	}
+	dtmf_decoder_ctx_t *ctx = dtmf_decoder_ctx_create(dtmf.sample_rate);
+	if (!ctx) {
+		printf("Failed to create the decoder\n");
+		buffer_terminate(&dtmf.buffer);
+		return 1;
+	}
+	size_t nb_references;
+	size_t len;
+	const int16_t *references =
+		dtmf_decoder_ctx_references(ctx, &nb_references, &len);
+
+	/* A window of zeros, then the press */
+	int16_t *signal = calloc(len + dtmf.buffer.len, sizeof(*signal));
+	if (!signal) {
+		printf("Failed to allocate the signal\n");
+		dtmf_decoder_ctx_terminate(ctx);
+		buffer_terminate(&dtmf.buffer);
+		return 1;
+	}
+	memcpy(signal + len, dtmf.buffer.data,
+	       dtmf.buffer.len * sizeof(*signal));
+	const size_t zeros = 0;
+	const size_t press = len;
+
+	/*
+	 * Zeros before any press are skipped, zeros inside a press continue
+	 * it: 3 presses before the first silence, then 1
+	 */
+	window_t windows[] = {
+		{ .data_offset = zeros, .silences_after = 1 },
+		{ .data_offset = press },
+		{ .data_offset = zeros },
+		{ .data_offset = press, .silences_after = 1 },
+		{ .data_offset = press },
+	};
+	bool ok = true;
+	for (size_t i = 0; i < ARRAY_LEN(windows); ++i) {
+		const int16_t *window = signal + windows[i].data_offset;
+		const uint8_t best =
+			best_reference(window, references, nb_references, len);
+		windows[i].button_index =
+			fpga_button_index(best, nb_references);
+
+		const uint8_t expected = windows[i].data_offset == zeros ?
+						 WINDOW_NO_BUTTON :
+						 PRESSED_BUTTON;
+		if (windows[i].button_index != expected) {
+			printf("Window %zu: expected button %u but got %u\n", i,
+			       expected, windows[i].button_index);
+			ok = false;
+		}
+	}
+	if (fpga_button_index(nb_references, nb_references) !=
+	    WINDOW_NO_BUTTON) {
+		printf("A best reference past the loaded ones gave a button\n");
+		ok = false;
+	}
+
+	buffer_t list;
+	buffer_construct_view(&list, windows, ARRAY_LEN(windows),
+			      sizeof(*windows));
+	char *decoded = dtmf_decode_fpga_windows(&list);
+	if (!decoded || strcmp(decoded, EXPECTED_MESSAGE) != 0) {
+		printf("Expected \"%s\" but decoded \"%s\"\n", EXPECTED_MESSAGE,
+		       decoded ? decoded : "(null)");
+		ok = false;
+	}
+
+	free(decoded);
+	free(signal);
+	dtmf_decoder_ctx_terminate(ctx);
+	buffer_terminate(&dtmf.buffer);
+	printf("%s\n", ok ? "OK" : "KO");
+	return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
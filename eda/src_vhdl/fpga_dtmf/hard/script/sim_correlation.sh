@@ -0,0 +1,28 @@
+#!/bin/bash
+# Builds the test vectors with the C decoder, then runs correlation_tb with GHDL
+# in hard/sim
+
+set -e
+
+HARD_DIR=$(cd "$(dirname "$0")/.." && pwd)
+REPO_DIR=$(cd "$HARD_DIR/../../../.." && pwd)
+DTMF_SRC=$REPO_DIR/dtmf/src
+SIM_DIR=$HARD_DIR/sim
+
+if ! command -v ghdl > /dev/null; then
+	echo "ghdl not found, it is needed to run correlation_tb"
+	exit 1
+fi
+
+mkdir -p "$SIM_DIR"
+cd "$SIM_DIR"
+
+gcc -O2 -I"$DTMF_SRC" -I"$REPO_DIR/driver" \
+	$(ls "$DTMF_SRC"/*.c | grep -v -e main.c -e wave.c -e batch.c -e _neon.c) \
+	"$HARD_DIR/tb/correlation_vectors.c" -o correlation_vectors -lm -lpthread
+./correlation_vectors correlation_vectors.txt
+
+ghdl -a --std=08 "$HARD_DIR/src/correlation.vhd" "$HARD_DIR/tb/correlation_tb.vhd"
+ghdl -e --std=08 correlation_tb
+ghdl -r --std=08 correlation_tb -gVECTORS_FILE=correlation_vectors.txt \
+	--ieee-asserts=disable-at-0
@@ -18,10 +18,35 @@
 --                reference values to determine the most probable DTMF key.
 --                
 --                Features:
---                - Register space for input windows
---                - Register space for reference DTMF patterns
---                - Register for scalar product results
---                - Interrupt generation for completion signals
+--                - Two window banks, one is written while the other is
+--                  correlated
+--                - Resident bank of up to 16 reference DTMF patterns, loaded
+--                  once
+--                - One lane per reference: a start correlates the window with
+--                  every reference in parallel
+--                - Pipelined multiply accumulate, two samples per cycle and
+--                  per lane, see the latency at the correlation process
+--                - Registers for the |dot product| of each lane and the best
+--                  reference among the first NB_REFERENCES
+--                - Interrupt generation for completion signals, one per window
+--
+--                Register map (32 bits words):
+--                - 0          : ID
+--                - 1          : test register
+--                - 2          : start, bits 3..0 select the reference of the
+--                               dot product register, bit 4 the window bank
+--                - 3          : IRQ status, write 1 to clear
+--                - 4, 5       : |dot product| of the selected reference, low
+--                               and high words
+--                - 6          : number of references the best one is picked
+--                               from
+--                - 7          : index of the best reference, 0xFF when every
+--                               dot product is 0
+--                - 8, 9       : |dot product| of the best reference
+--                - 32..63     : |dot product| of reference r at 32 + 2 * r
+--                - 64..95     : window bank 0, two samples per word
+--                - 96..127    : window bank 1
+--                - 512..1023  : reference bank, reference r at 512 + 32 * r
 --
 --------------------------------------------------------------------------------
 -- Dependencies : - 
@@ -30,6 +55,10 @@
 -- Modifications :
 -- Ver    Date        Engineer    Comments
 -- 0.1    2025        SCF         Initial DTMF implementation
+-- 0.2    2026                    Resident reference bank, sequential MAC
+-- 0.3    2026                    Parallel lanes, argmax in hardware
+-- 0.4    2026                    Pipelined MAC, 40 bits accumulators
+-- 0.5    2026                    Double buffered window
 --------------------------------------------------------------------------------
 
 library ieee;
@@ -41,7 +70,7 @@ entity correlation is
     generic (
         AXI_ADDR_WIDTH      : natural := 12;
         AXI_DATA_WIDTH      : natural := 32;
-        AVL_ADDR_WIDTH      : natural := 13;  -- Increased to accommodate new memory layout
+        AVL_ADDR_WIDTH      : natural := 13   -- Increased to accommodate new memory layout
     );
     port (
         -- Clock and reset
@@ -87,10 +116,23 @@ architecture rtl of correlation is
     constant CONSTANT_ID                    : std_logic_vector(31 downto 0) := x"CAFE1234";    -- Expected ID value
     constant IRQ_STATUS_CALCULATION_DONE    : natural := 0;
 
+    -- Register map, in 32 bits words
+    constant MAGNITUDE_FIRST_WORD : natural := 32;
+    constant WINDOW_FIRST_WORD    : natural := 64;
+    constant WINDOW_WORDS         : natural := 32;
+    constant WINDOW_BANKS         : natural := 2;
+    constant REF_BANK_FIRST_WORD  : natural := 512;
+    constant NB_REFERENCES        : natural := 16;
+    constant NO_REFERENCE         : unsigned(7 downto 0) := x"FF";
+    -- |dot product| < 64 * 2^30, the registers are zero extended to 64 bits
+    constant ACC_WIDTH            : natural := 40;
+
     signal irq_status_reg         : std_logic_vector(31 downto 0);
     
     -- Control signals
     signal start_calculation       : std_logic;
+    signal start_ref_index_s       : unsigned(3 downto 0);
+    signal start_window_bank_s     : natural range 0 to WINDOW_BANKS-1;
     signal calculation_done        : std_logic;
 
     -- Correlation computation signals
@@ -119,8 +161,45 @@ architecture rtl of correlation is
     signal test_register_s     : std_logic_vector(AXI_DATA_WIDTH-1 downto 0);
 
     type sample_array_t is array (0 to 63) of std_logic_vector(15 downto 0);
-    signal window_samples_s : sample_array_t;
-    signal ref_samples_s : sample_array_t;
+    type window_bank_array_t is array (0 to WINDOW_BANKS-1) of sample_array_t;
+    signal window_samples_s : window_bank_array_t;
+
+    -- Reference bank, one RAM per reference so that every lane reads its
+    -- word on the same cycle. A word holds two samples like the registers
+    type word_array_t is array (0 to NB_REFERENCES-1) of std_logic_vector(31 downto 0);
+    signal ref_bank_addr_s : unsigned(8 downto 0);  -- Reference & word
+    signal ref_ram_we_s    : std_logic;
+    signal ref_ram_q_s     : word_array_t;
+
+    -- Multiply accumulate over the window, one word (two samples) per cycle
+    -- and per lane. Stages: bank read and window pair, products, sum of the
+    -- two products, accumulation
+    constant MAC_STAGES : natural := 3;
+    type mac_state_t is (MAC_IDLE, MAC_RUN, MAC_MAGNITUDE, MAC_ARGMAX, MAC_DONE);
+    type product_array_t is array (0 to NB_REFERENCES-1) of signed(31 downto 0);
+    type pair_sum_array_t is array (0 to NB_REFERENCES-1) of signed(32 downto 0);
+    type accumulator_array_t is array (0 to NB_REFERENCES-1) of signed(ACC_WIDTH-1 downto 0);
+    type magnitude_array_t is array (0 to NB_REFERENCES-1) of unsigned(ACC_WIDTH-1 downto 0);
+    signal mac_state_s     : mac_state_t;
+    signal mac_ref_index_s : unsigned(3 downto 0);
+    signal mac_window_bank_s : natural range 0 to WINDOW_BANKS-1;
+    signal mac_word_s      : unsigned(5 downto 0);  -- Next word to read
+    -- Stage n of the pipe holds a pair, the last one of the window
+    signal mac_valid_s     : std_logic_vector(MAC_STAGES-1 downto 0);
+    signal mac_last_s      : std_logic_vector(MAC_STAGES-1 downto 0);
+    signal window_lo_s     : signed(15 downto 0);
+    signal window_hi_s     : signed(15 downto 0);
+    signal products_lo_s   : product_array_t;
+    signal products_hi_s   : product_array_t;
+    signal pair_sums_s     : pair_sum_array_t;
+    signal accumulators_s  : accumulator_array_t;
+
+    -- Results
+    signal nb_references_s  : unsigned(4 downto 0);
+    signal magnitudes_s     : magnitude_array_t;
+    signal argmax_lane_s    : unsigned(4 downto 0);
+    signal best_index_s     : unsigned(7 downto 0);
+    signal best_magnitude_s : unsigned(ACC_WIDTH-1 downto 0);
 
 begin
 
@@ -201,10 +280,14 @@ begin
         variable int_waddr_v : natural;
         variable byte_index  : integer;
         variable sample_offset : integer;
+        variable window_bank_v : integer;
     begin
         if rst_i = '1' then
             irq_status_reg    <= (others => '0');
             start_calculation <= '0';
+            start_ref_index_s <= (others => '0');
+            start_window_bank_s <= 0;
+            nb_references_s   <= (others => '0');
             axi_write_done_s  <= '1';
         elsif rising_edge(clk_i) then
             axi_write_done_s <= '0';
@@ -215,19 +298,30 @@ begin
                 int_waddr_v := to_integer(unsigned(axi_waddr_mem_s));
                 case int_waddr_v is
                     when 1 => test_register_s <= axi_wdata_i;
-                    when 2 => start_calculation <= '1';
+                    when 2 =>
+                        start_calculation <= '1';
+                        start_ref_index_s <= unsigned(axi_wdata_i(3 downto 0));
+                        if axi_wdata_i(4) = '1' then
+                            start_window_bank_s <= 1;
+                        else
+                            start_window_bank_s <= 0;
+                        end if;
                     when 3 => irq_status_reg <= irq_status_reg and not axi_wdata_i;
+                    when 6 =>
+                        if unsigned(axi_wdata_i) > NB_REFERENCES then
+                            nb_references_s <= to_unsigned(NB_REFERENCES, nb_references_s'length);
+                        else
+                            nb_references_s <= unsigned(axi_wdata_i(4 downto 0));
+                        end if;
                     when others => 
                         -- 0x100
-                        if(int_waddr_v >= 64 and int_waddr_v <= 96) then
+                        if(int_waddr_v >= WINDOW_FIRST_WORD and
+                           int_waddr_v < WINDOW_FIRST_WORD + WINDOW_BANKS * WINDOW_WORDS) then
                             -- not necessarily an optimisation but it's more readable
-                            sample_offset := (int_waddr_v - 64) * 2;
-                            window_samples_s(sample_offset) <= axi_wdata_i(15 downto 0);
-                            window_samples_s(sample_offset + 1) <= axi_wdata_i(31 downto 16);
-                        elsif (int_waddr_v >= 97 and int_waddr_v <= 161) then
-                            sample_offset := (int_waddr_v - 97) * 2;
-                            ref_samples_s(sample_offset) <= axi_wdata_i(15 downto 0);
-                            ref_samples_s(sample_offset + 1) <= axi_wdata_i(31 downto 16);
+                            window_bank_v := (int_waddr_v - WINDOW_FIRST_WORD) / WINDOW_WORDS;
+                            sample_offset := ((int_waddr_v - WINDOW_FIRST_WORD) mod WINDOW_WORDS) * 2;
+                            window_samples_s(window_bank_v)(sample_offset) <= axi_wdata_i(15 downto 0);
+                            window_samples_s(window_bank_v)(sample_offset + 1) <= axi_wdata_i(31 downto 16);
                         end if;
                 end case;
             end if;
@@ -240,6 +334,30 @@ begin
     end process;
 
 
+    -----------------------------------------------------------
+    -- Reference bank
+
+    -- Written from the AXI bus at 0x800, every lane reads the same word of
+    -- its reference on each cycle. No reset so that they are inferred as RAMs
+    ref_ram_we_s <= axi_data_wren_s when
+                    to_integer(unsigned(axi_waddr_mem_s)) >= REF_BANK_FIRST_WORD else '0';
+    ref_bank_addr_s <= resize(unsigned(axi_waddr_mem_s), ref_bank_addr_s'length);
+
+    ref_rams : for r in 0 to NB_REFERENCES-1 generate
+        type ref_ram_t is array (0 to WINDOW_WORDS-1) of std_logic_vector(31 downto 0);
+        signal ref_ram_s : ref_ram_t;
+    begin
+        process (clk_i)
+        begin
+            if rising_edge(clk_i) then
+                if ref_ram_we_s = '1' and to_integer(ref_bank_addr_s(8 downto 5)) = r then
+                    ref_ram_s(to_integer(ref_bank_addr_s(4 downto 0))) <= axi_wdata_i;
+                end if;
+                ref_ram_q_s(r) <= ref_ram_s(to_integer(mac_word_s(4 downto 0)));
+            end if;
+        end process;
+    end generate;
+
     -----------------------------------------------------------
     -- Write respond channel
 
@@ -336,8 +454,10 @@ begin
     axi_data_rden_s <= axi_raddr_done_s and (not axi_rvalid_s);
 
     process (test_register_s, irq_status_reg,
-             dot_product, axi_araddr_mem_s)
+             dot_product, nb_references_s, best_index_s, best_magnitude_s,
+             magnitudes_s, axi_araddr_mem_s)
     variable int_raddr_v : natural;
+    variable lane_v      : natural;
     begin
         int_raddr_v := to_integer(unsigned(axi_araddr_mem_s));
         axi_rdata_s <= (others => '0');
@@ -347,6 +467,17 @@ begin
             when 3 => axi_rdata_s <= irq_status_reg;
             when 4 => axi_rdata_s <= std_logic_vector(dot_product(31 downto 0));
             when 5 => axi_rdata_s <= std_logic_vector(dot_product(63 downto 32));
+            when 6 => axi_rdata_s <= std_logic_vector(resize(nb_references_s, 32));
+            when 7 => axi_rdata_s <= std_logic_vector(resize(best_index_s, 32));
+            when 8 => axi_rdata_s <= std_logic_vector(best_magnitude_s(31 downto 0));
+            when 9 => axi_rdata_s <= std_logic_vector(resize(best_magnitude_s(ACC_WIDTH-1 downto 32), 32));
+            when MAGNITUDE_FIRST_WORD to MAGNITUDE_FIRST_WORD + 2 * NB_REFERENCES - 1 =>
+                lane_v := (int_raddr_v - MAGNITUDE_FIRST_WORD) / 2;
+                if int_raddr_v mod 2 = 0 then
+                    axi_rdata_s <= std_logic_vector(magnitudes_s(lane_v)(31 downto 0));
+                else
+                    axi_rdata_s <= std_logic_vector(resize(magnitudes_s(lane_v)(ACC_WIDTH-1 downto 32), 32));
+                end if;
             when others => axi_rdata_s <= x"A5A5A5A5";
         end case;
     end process;
@@ -366,36 +497,131 @@ begin
         end if;
     end process;
 
+    -----------------------------------------------------------
+    -- Correlation
+
+    -- A start in MAC_IDLE latches the reference index and the window bank,
+    -- the other bank can then be written during the calculation. The window is
+    -- multiplied with every reference of the bank, two samples per cycle and
+    -- per lane. Each pair goes through four registered stages: bank read with
+    -- the window pair, the two products, their sum and the accumulation, so
+    -- that no multiplier feeds an adder in the same cycle. The magnitudes are
+    -- then scanned for the best one, lowest index first and strictly greater
+    -- like the C decoder.
+    --
+    -- Latency: the interrupt rises WINDOW_WORDS + NB_REFERENCES (register 6)
+    -- + 8 cycles after the start register write, starts received meanwhile
+    -- are ignored
     process(clk_i, rst_i)
-        variable temp_sum : signed(63 downto 0);
-        variable abs_temp_sum : signed(63 downto 0);
+        variable ref_word_v   : std_logic_vector(31 downto 0);
+        variable abs_temp_sum : signed(ACC_WIDTH-1 downto 0);
     begin
         if rst_i = '1' then
             calculation_done <= '0';
-            dot_product <= (others => '0');
+            dot_product      <= (others => '0');
+            mac_state_s      <= MAC_IDLE;
+            mac_ref_index_s  <= (others => '0');
+            mac_window_bank_s <= 0;
+            mac_word_s       <= (others => '0');
+            mac_valid_s      <= (others => '0');
+            mac_last_s       <= (others => '0');
+            window_lo_s      <= (others => '0');
+            window_hi_s      <= (others => '0');
+            products_lo_s    <= (others => (others => '0'));
+            products_hi_s    <= (others => (others => '0'));
+            pair_sums_s      <= (others => (others => '0'));
+            accumulators_s   <= (others => (others => '0'));
+            magnitudes_s     <= (others => (others => '0'));
+            argmax_lane_s    <= (others => '0');
+            best_index_s     <= NO_REFERENCE;
+            best_magnitude_s <= (others => '0');
         elsif rising_edge(clk_i) then
-            if calculation_done = '1' then
-                calculation_done <= '0';
+            calculation_done <= '0';
+
+            -- Pipe, the bank answers one cycle after the address
+            mac_valid_s <= mac_valid_s(MAC_STAGES-2 downto 0) & '0';
+            mac_last_s  <= mac_last_s(MAC_STAGES-2 downto 0) & '0';
+
+            if mac_valid_s(0) = '1' then
+                for r in 0 to NB_REFERENCES-1 loop
+                    ref_word_v := ref_ram_q_s(r);
+                    products_lo_s(r) <= window_lo_s * signed(ref_word_v(15 downto 0));
+                    products_hi_s(r) <= window_hi_s * signed(ref_word_v(31 downto 16));
+                end loop;
             end if;
 
-            if start_calculation = '1' then
-                temp_sum := (others => '0');
-                for i in 0 to 63 loop
-                    temp_sum := temp_sum + (signed(window_samples_s(i)) * signed(ref_samples_s(i)));
+            if mac_valid_s(1) = '1' then
+                for r in 0 to NB_REFERENCES-1 loop
+                    pair_sums_s(r) <= resize(products_lo_s(r), pair_sums_s(r)'length) +
+                                      resize(products_hi_s(r), pair_sums_s(r)'length);
                 end loop;
+            end if;
 
-                if temp_sum < 0 then
-                    abs_temp_sum := -temp_sum;
-                else
-                    abs_temp_sum := temp_sum;
-                end if;
-                
-                dot_product <= abs_temp_sum;
-                calculation_done <= '1';
+            if mac_valid_s(2) = '1' then
+                for r in 0 to NB_REFERENCES-1 loop
+                    accumulators_s(r) <= accumulators_s(r) +
+                                         resize(pair_sums_s(r), ACC_WIDTH);
+                end loop;
             end if;
+
+            case mac_state_s is
+                when MAC_IDLE =>
+                    if start_calculation = '1' then
+                        mac_ref_index_s <= start_ref_index_s;
+                        mac_window_bank_s <= start_window_bank_s;
+                        mac_word_s      <= (others => '0');
+                        accumulators_s  <= (others => (others => '0'));
+                        mac_state_s     <= MAC_RUN;
+                    end if;
+
+                when MAC_RUN =>
+                    if mac_word_s < WINDOW_WORDS then
+                        window_lo_s    <= signed(window_samples_s(mac_window_bank_s)(to_integer(mac_word_s) * 2));
+                        window_hi_s    <= signed(window_samples_s(mac_window_bank_s)(to_integer(mac_word_s) * 2 + 1));
+                        mac_valid_s(0) <= '1';
+                        if mac_word_s = WINDOW_WORDS - 1 then
+                            mac_last_s(0) <= '1';
+                        end if;
+                        mac_word_s     <= mac_word_s + 1;
+                    end if;
+
+                    if mac_last_s(MAC_STAGES-1) = '1' then
+                        mac_state_s <= MAC_MAGNITUDE;
+                    end if;
+
+                when MAC_MAGNITUDE =>
+                    for r in 0 to NB_REFERENCES-1 loop
+                        if accumulators_s(r) < 0 then
+                            abs_temp_sum := -accumulators_s(r);
+                        else
+                            abs_temp_sum := accumulators_s(r);
+                        end if;
+                        magnitudes_s(r) <= unsigned(abs_temp_sum);
+                    end loop;
+                    argmax_lane_s    <= (others => '0');
+                    best_index_s     <= NO_REFERENCE;
+                    best_magnitude_s <= (others => '0');
+                    mac_state_s      <= MAC_ARGMAX;
+
+                when MAC_ARGMAX =>
+                    if argmax_lane_s < nb_references_s then
+                        if magnitudes_s(to_integer(argmax_lane_s)) > best_magnitude_s then
+                            best_magnitude_s <= magnitudes_s(to_integer(argmax_lane_s));
+                            best_index_s     <= resize(argmax_lane_s, best_index_s'length);
+                        end if;
+                        argmax_lane_s <= argmax_lane_s + 1;
+                    else
+                        mac_state_s <= MAC_DONE;
+                    end if;
+
+                when MAC_DONE =>
+                    dot_product      <= signed(resize(magnitudes_s(to_integer(mac_ref_index_s)), 64));
+                    calculation_done <= '1';
+                    mac_state_s      <= MAC_IDLE;
+            end case;
         end if;
     end process;
-    
+
     -- IRQ output generation
     irq_o <= irq_status_reg(IRQ_STATUS_CALCULATION_DONE);
 
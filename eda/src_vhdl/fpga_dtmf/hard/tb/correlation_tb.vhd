@@ -0,0 +1,450 @@
+--------------------------------------------------------------------------------
+-- HEIG-VD
+-- Haute Ecole d'Ingenerie et de Gestion du Canton de Vaud
+-- School of Business and Engineering in Canton de Vaud
+--------------------------------------------------------------------------------
+-- REDS Institute
+-- Reconfigurable Embedded Digital Systems
+--------------------------------------------------------------------------------
+--
+-- File     : correlation_tb.vhd
+-- Date     : 2026
+--
+-- Context  : DTMF Analysis using Correlation
+--
+--------------------------------------------------------------------------------
+-- Description :  Testbench of correlation.vhd driven over AXI4-Lite like the
+--                driver does. The button references of the C decoder are
+--                loaded once in the reference bank, then every window of the
+--                vectors file is correlated with all of them by a single
+--                start. The |dot product| of each lane and the best reference
+--                are checked against the ones computed by
+--                correlation_vectors.c.
+--
+--                The windows are run twice: one after the other in window
+--                bank 0, then each one uploaded in the other bank while the
+--                previous one is correlated, like the driver does.
+--
+--                Reports the cycles per correlation, from a start register
+--                write to the interrupt, and the cycles per window of both
+--                driver sequences: upload, start, interrupt ack and read of
+--                the best reference.
+--
+--------------------------------------------------------------------------------
+-- Dependencies : correlation.vhd, vectors from correlation_vectors.c,
+--                VHDL-2008 (hread, to_hstring)
+--
+--------------------------------------------------------------------------------
+-- Modifications :
+-- Ver    Date        Engineer    Comments
+-- 0.1    2026                    Initial version, resident references
+-- 0.2    2026                    One start per window, hardware argmax
+-- 0.3    2026                    Cycles per correlation of the pipelined MAC
+-- 0.4    2026                    Double buffered window
+--------------------------------------------------------------------------------
+
+library ieee;
+use ieee.std_logic_1164.all;
+use ieee.numeric_std.all;
+use std.textio.all;
+
+entity correlation_tb is
+    generic (
+        VECTORS_FILE : string := "correlation_vectors.txt"
+    );
+end correlation_tb;
+
+architecture testbench of correlation_tb is
+    -- Clock of the IP in qsys_system
+    constant CLK_PERIOD         : time := 20 ns;
+    constant AXI_ADDR_WIDTH     : natural := 12;
+    constant AXI_DATA_WIDTH     : natural := 32;
+
+    -- Register map of correlation.vhd, byte addresses
+    constant START_ADDR         : natural := 16#008#;
+    constant IRQ_STATUS_ADDR    : natural := 16#00C#;
+    constant DOT_ADDR           : natural := 16#010#;
+    constant NB_REFERENCES_ADDR : natural := 16#018#;
+    constant BEST_INDEX_ADDR    : natural := 16#01C#;
+    constant BEST_DOT_ADDR      : natural := 16#020#;
+    constant MAGNITUDES_ADDR    : natural := 16#080#;
+    constant WINDOW_ADDR        : natural := 16#100#;
+    constant WINDOW_BANK_STRIDE : natural := 16#080#;
+    constant WINDOW_BANKS       : natural := 2;
+    -- Start register bit of the window bank
+    constant START_WINDOW_BANK  : natural := 16#10#;
+    constant REF_BANK_ADDR      : natural := 16#800#;
+    constant REF_STRIDE         : natural := 16#080#;
+    constant MAX_WINDOW_SAMPLES : natural := 64;
+    constant NB_REFERENCES      : natural := 16;
+    -- Best index of a window whose dot products are all 0
+    constant NO_REFERENCE       : natural := 16#FF#;
+    -- A correlation longer than this is reported as stuck
+    constant TIMEOUT_CYCLES     : natural := 1000;
+
+    type sample_array_t is array (0 to MAX_WINDOW_SAMPLES-1) of integer;
+    type dot_array_t is array (0 to NB_REFERENCES-1) of unsigned(63 downto 0);
+
+    signal clk_s       : std_logic := '0';
+    signal rst_s       : std_logic := '1';
+    signal sim_end_s   : boolean := false;
+    signal cycle_s     : natural := 0;
+
+    signal awaddr_s    : std_logic_vector(AXI_ADDR_WIDTH-1 downto 0) := (others => '0');
+    signal awvalid_s   : std_logic := '0';
+    signal awready_s   : std_logic;
+    signal wdata_s     : std_logic_vector(AXI_DATA_WIDTH-1 downto 0) := (others => '0');
+    signal wvalid_s    : std_logic := '0';
+    signal wready_s    : std_logic;
+    signal bresp_s     : std_logic_vector(1 downto 0);
+    signal bvalid_s    : std_logic;
+    signal araddr_s    : std_logic_vector(AXI_ADDR_WIDTH-1 downto 0) := (others => '0');
+    signal arvalid_s   : std_logic := '0';
+    signal arready_s   : std_logic;
+    signal rdata_s     : std_logic_vector(AXI_DATA_WIDTH-1 downto 0);
+    signal rresp_s     : std_logic_vector(1 downto 0);
+    signal rvalid_s    : std_logic;
+    signal irq_s       : std_logic;
+    signal avl_readdata_s    : std_logic_vector(31 downto 0);
+    signal avl_waitrequest_s : std_logic;
+
+    -- Register holding the samples 2 * pair and 2 * pair + 1
+    function sample_pair(samples : sample_array_t; pair : natural)
+        return std_logic_vector is
+    begin
+        return std_logic_vector(to_signed(samples(2 * pair + 1), 16)) &
+               std_logic_vector(to_signed(samples(2 * pair), 16));
+    end function;
+
+begin
+
+    dut : entity work.correlation
+        generic map (
+            AXI_ADDR_WIDTH => AXI_ADDR_WIDTH,
+            AXI_DATA_WIDTH => AXI_DATA_WIDTH
+        )
+        port map (
+            clk_i                 => clk_s,
+            rst_i                 => rst_s,
+            axi_awaddr_i          => awaddr_s,
+            axi_awprot_i          => "000",
+            axi_awvalid_i         => awvalid_s,
+            axi_awready_o         => awready_s,
+            axi_wdata_i           => wdata_s,
+            axi_wstrb_i           => "1111",
+            axi_wvalid_i          => wvalid_s,
+            axi_wready_o          => wready_s,
+            axi_bresp_o           => bresp_s,
+            axi_bvalid_o          => bvalid_s,
+            axi_bready_i          => '1',
+            axi_araddr_i          => araddr_s,
+            axi_arprot_i          => "000",
+            axi_arvalid_i         => arvalid_s,
+            axi_arready_o         => arready_s,
+            axi_rdata_o           => rdata_s,
+            axi_rresp_o           => rresp_s,
+            axi_rvalid_o          => rvalid_s,
+            axi_rready_i          => '1',
+            avl_mem_address_i     => (others => '0'),
+            avl_mem_write_i       => '0',
+            avl_mem_read_i        => '0',
+            avl_mem_byteenable_i  => "0000",
+            avl_mem_writedata_i   => (others => '0'),
+            avl_mem_readdata_o    => avl_readdata_s,
+            avl_mem_waitrequest_o => avl_waitrequest_s,
+            irq_o                 => irq_s
+        );
+
+    clk_gen : process
+    begin
+        while not sim_end_s loop
+            clk_s <= '0';
+            wait for CLK_PERIOD / 2;
+            clk_s <= '1';
+            wait for CLK_PERIOD / 2;
+        end loop;
+        wait;
+    end process;
+
+    cycle_counter : process (clk_s)
+    begin
+        if rising_edge(clk_s) then
+            cycle_s <= cycle_s + 1;
+        end if;
+    end process;
+
+    stimulus : process
+        file vectors_f          : text;
+        variable line_v         : line;
+        variable window_samples_v : natural;
+        variable nb_references_v  : natural;
+        variable nb_windows_v     : natural;
+        variable nb_pairs_v       : natural;
+        variable samples_v      : sample_array_t;
+        variable expected_v     : dot_array_t;
+        variable expected_best_v : natural;
+        variable hex_v          : std_logic_vector(63 downto 0);
+        variable best_v         : natural;
+        variable best_dot_v     : unsigned(63 downto 0);
+        variable data_v         : std_logic_vector(31 downto 0);
+        variable bank_v         : natural;
+        variable cycles_v       : natural;
+        variable start_v        : natural;
+        variable window_start_v : natural;
+        variable check_start_v  : natural;
+        variable load_cycles_v  : natural;
+        variable calc_cycles_v  : natural := 0;
+        variable window_cycles_v : natural := 0;
+        variable max_calc_cycles_v : natural := 0;
+        variable overlap_cycles_v  : natural := 0;
+        variable check_cycles_v    : natural := 0;
+        variable errors_v       : natural := 0;
+
+        procedure axi_write(addr : natural; data : std_logic_vector(31 downto 0)) is
+        begin
+            awaddr_s  <= std_logic_vector(to_unsigned(addr, AXI_ADDR_WIDTH));
+            awvalid_s <= '1';
+            wdata_s   <= data;
+            wvalid_s  <= '1';
+            wait until rising_edge(clk_s) and awready_s = '1';
+            awvalid_s <= '0';
+            wait until rising_edge(clk_s) and wready_s = '1';
+            wvalid_s  <= '0';
+            wait until rising_edge(clk_s) and bvalid_s = '1';
+        end procedure;
+
+        procedure axi_read(addr : natural; data : out std_logic_vector(31 downto 0)) is
+        begin
+            araddr_s  <= std_logic_vector(to_unsigned(addr, AXI_ADDR_WIDTH));
+            arvalid_s <= '1';
+            wait until rising_edge(clk_s) and arready_s = '1';
+            arvalid_s <= '0';
+            wait until rising_edge(clk_s) and rvalid_s = '1';
+            data := rdata_s;
+        end procedure;
+
+        procedure axi_read64(addr : natural; data : out unsigned(63 downto 0)) is
+            variable low_v  : std_logic_vector(31 downto 0);
+            variable high_v : std_logic_vector(31 downto 0);
+        begin
+            axi_read(addr + 4, high_v);
+            axi_read(addr, low_v);
+            data := unsigned(high_v & low_v);
+        end procedure;
+
+        -- Reads one line of samples, the end of the window stays at 0
+        procedure read_samples(samples : out sample_array_t) is
+        begin
+            samples := (others => 0);
+            readline(vectors_f, line_v);
+            for i in 0 to window_samples_v - 1 loop
+                read(line_v, samples(i));
+            end loop;
+        end procedure;
+
+        -- Dot products and best reference of the window read last
+        procedure read_expected is
+        begin
+            readline(vectors_f, line_v);
+            for j in 0 to nb_references_v - 1 loop
+                hread(line_v, hex_v);
+                expected_v(j) := unsigned(hex_v);
+            end loop;
+            read(line_v, expected_best_v);
+        end procedure;
+
+        -- Header and references, loaded once like IOCTL_SET_REF_SIGNAL_ADDR
+        procedure open_vectors(load : boolean) is
+        begin
+            file_open(vectors_f, VECTORS_FILE, read_mode);
+            readline(vectors_f, line_v);
+            read(line_v, window_samples_v);
+            read(line_v, nb_references_v);
+            read(line_v, nb_windows_v);
+            assert window_samples_v <= MAX_WINDOW_SAMPLES and
+                   nb_references_v <= NB_REFERENCES
+                report "Vectors don't fit in the correlator" severity failure;
+            nb_pairs_v := (window_samples_v + 1) / 2;
+
+            for j in 0 to nb_references_v - 1 loop
+                read_samples(samples_v);
+                if load then
+                    for p in 0 to nb_pairs_v - 1 loop
+                        axi_write(REF_BANK_ADDR + j * REF_STRIDE + p * 4,
+                                  sample_pair(samples_v, p));
+                    end loop;
+                end if;
+            end loop;
+            if load then
+                axi_write(NB_REFERENCES_ADDR,
+                          std_logic_vector(to_unsigned(nb_references_v, 32)));
+            end if;
+        end procedure;
+
+        procedure write_window(bank : natural) is
+        begin
+            for p in 0 to nb_pairs_v - 1 loop
+                axi_write(WINDOW_ADDR + bank * WINDOW_BANK_STRIDE + p * 4,
+                          sample_pair(samples_v, p));
+            end loop;
+        end procedure;
+
+        -- Same sequence as start_calculation and wait_calculation of the
+        -- driver, the start selects reference 0
+        procedure start_calculation(bank : natural) is
+        begin
+            axi_write(START_ADDR,
+                      std_logic_vector(to_unsigned(bank * START_WINDOW_BANK, 32)));
+        end procedure;
+
+        procedure wait_calculation(start : natural; cycles : out natural) is
+        begin
+            if irq_s /= '1' then
+                wait until rising_edge(clk_s) and irq_s = '1'
+                    for TIMEOUT_CYCLES * CLK_PERIOD;
+            end if;
+            assert irq_s = '1' report "No interrupt" severity failure;
+            cycles := cycle_s - start;
+            axi_write(IRQ_STATUS_ADDR, x"00000001");
+        end procedure;
+
+        procedure read_best is
+        begin
+            axi_read(BEST_INDEX_ADDR, data_v);
+            best_v := to_integer(unsigned(data_v(7 downto 0)));
+            axi_read64(BEST_DOT_ADDR, best_dot_v);
+        end procedure;
+
+        -- Every result register of window w against the vectors
+        procedure check_results(w : natural) is
+            variable dot_v          : unsigned(63 downto 0);
+            variable expected_dot_v : unsigned(63 downto 0);
+        begin
+            for j in 0 to nb_references_v - 1 loop
+                axi_read64(MAGNITUDES_ADDR + j * 8, dot_v);
+                if dot_v /= expected_v(j) then
+                    report "Window " & integer'image(w) & " reference " &
+                           integer'image(j) & ": got " & to_hstring(dot_v) &
+                           " expected " & to_hstring(expected_v(j))
+                        severity error;
+                    errors_v := errors_v + 1;
+                end if;
+            end loop;
+
+            axi_read64(DOT_ADDR, dot_v);
+            if dot_v /= expected_v(0) then
+                report "Window " & integer'image(w) & ": selected dot " &
+                       to_hstring(dot_v) & " expected " &
+                       to_hstring(expected_v(0))
+                    severity error;
+                errors_v := errors_v + 1;
+            end if;
+
+            if expected_best_v = NO_REFERENCE then
+                expected_dot_v := (others => '0');
+            else
+                expected_dot_v := expected_v(expected_best_v);
+            end if;
+            if best_v /= expected_best_v or best_dot_v /= expected_dot_v then
+                report "Window " & integer'image(w) & ": best reference " &
+                       integer'image(best_v) & " (" & to_hstring(best_dot_v) &
+                       ") expected " & integer'image(expected_best_v) &
+                       " (" & to_hstring(expected_dot_v) & ")"
+                    severity error;
+                errors_v := errors_v + 1;
+            end if;
+        end procedure;
+
+    begin
+        rst_s <= '1';
+        wait for 5 * CLK_PERIOD;
+        wait until rising_edge(clk_s);
+        rst_s <= '0';
+        wait until rising_edge(clk_s);
+
+        -- Neither the window banks nor the reference bank are reset, only
+        -- the used samples are written afterwards
+        for i in 0 to WINDOW_BANKS * MAX_WINDOW_SAMPLES / 2 - 1 loop
+            axi_write(WINDOW_ADDR + i * 4, x"00000000");
+        end loop;
+        for i in 0 to NB_REFERENCES * MAX_WINDOW_SAMPLES / 2 - 1 loop
+            axi_write(REF_BANK_ADDR + i * 4, x"00000000");
+        end loop;
+
+        load_cycles_v := cycle_s;
+        open_vectors(true);
+        load_cycles_v := cycle_s - load_cycles_v;
+
+        -- One window after the other in bank 0: upload, start, wait, read
+        for w in 0 to nb_windows_v - 1 loop
+            read_samples(samples_v);
+            read_expected;
+
+            window_start_v := cycle_s;
+            write_window(0);
+            start_v := cycle_s;
+            start_calculation(0);
+            wait_calculation(start_v, cycles_v);
+            read_best;
+            window_cycles_v := window_cycles_v + cycle_s - window_start_v;
+
+            calc_cycles_v := calc_cycles_v + cycles_v;
+            if cycles_v > max_calc_cycles_v then
+                max_calc_cycles_v := cycles_v;
+            end if;
+            check_results(w);
+        end loop;
+        file_close(vectors_f);
+
+        -- Same windows, each one uploaded in the other bank while the
+        -- previous one is correlated, like IOCTL_CORRELATE_WINDOWS
+        open_vectors(false);
+        read_samples(samples_v);
+        read_expected;
+        bank_v := 0;
+        window_start_v := cycle_s;
+        write_window(bank_v);
+        for w in 0 to nb_windows_v - 1 loop
+            start_v := cycle_s;
+            start_calculation(bank_v);
+            bank_v := 1 - bank_v;
+            if w + 1 < nb_windows_v then
+                read_samples(samples_v);
+                write_window(bank_v);
+            end if;
+            wait_calculation(start_v, cycles_v);
+            read_best;
+
+            -- Checks aren't part of the driver sequence
+            check_start_v := cycle_s;
+            check_results(w);
+            if w + 1 < nb_windows_v then
+                read_expected;
+            end if;
+            check_cycles_v := check_cycles_v + cycle_s - check_start_v;
+        end loop;
+        overlap_cycles_v := cycle_s - window_start_v - check_cycles_v;
+        file_close(vectors_f);
+
+        report "References loaded in " & integer'image(load_cycles_v) &
+               " cycles";
+        report integer'image(nb_windows_v) & " windows against " &
+               integer'image(nb_references_v) & " references: " &
+               integer'image(calc_cycles_v / nb_windows_v) &
+               " cycles per correlation (max " &
+               integer'image(max_calc_cycles_v) & ", " &
+               time'image(calc_cycles_v / nb_windows_v * CLK_PERIOD) & ")";
+        report "Cycles per window: " &
+               integer'image(window_cycles_v / nb_windows_v) &
+               " one after the other, " &
+               integer'image(overlap_cycles_v / nb_windows_v) &
+               " with the upload in the other bank";
+        assert errors_v = 0
+            report integer'image(errors_v) & " mismatches" severity failure;
+        report "correlation_tb passed";
+
+        sim_end_s <= true;
+        wait;
+    end process;
+
+end testbench;
@@ -0,0 +1,193 @@
+/*
+ * Test vectors of correlation_tb.vhd, computed by the C decoder: the button
+ * references and the windows of an encoded message, with the |dot product| of
+ * every window and reference and the best reference of each window, picked
+ * like decode_button_time_domain_combined does.
+ *
+ * The message is followed by a window of zeros, whose best reference is
+ * NO_REFERENCE, and by windows where two references tie for the best one,
+ * which goes to the lowest index.
+ *
+ * Text output, one line each: "window_samples nb_references nb_windows", the
+ * samples of every reference, then per window its samples followed by its
+ * nb_references dot products in hexadecimal and the index of the best one.
+ */
+#include "dot_product.h"
+#include "dtmf.h"
+#include "dtmf_private.h"
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define VECTORS_MESSAGE "0123456789 hello world"
+/* Windows start every WINDOW_STEP samples, silences included */
+#define WINDOW_STEP	400
+/* Best index of a window whose dot products are all 0 */
+#define NO_REFERENCE	0xff
+/* Windows, two non zero samples each, where two references tie */
+#define NB_TIE_WINDOWS	4
+
+static void write_samples(FILE *file, const int16_t *samples, size_t len)
+{
+	for (size_t i = 0; i < len; ++i) {
+		fprintf(file, i == 0 ? "%d" : " %d", samples[i]);
+	}
+	fprintf(file, "\n");
+}
+
+static unsigned write_window(FILE *file, const int16_t *window,
+			     const int16_t *references, size_t nb_references,
+			     size_t len)
+{
+	unsigned best = NO_REFERENCE;
+	uint64_t best_dot = 0;
+
+	write_samples(file, window, len);
+	for (size_t j = 0; j < nb_references; ++j) {
+		const uint64_t dot =
+			dot_product(window, references + j * len, len);
+		fprintf(file, "%016llx ", (unsigned long long)dot);
+		if (dot > best_dot) {
+			best_dot = dot;
+			best = j;
+		}
+	}
+	fprintf(file, "%u\n", best);
+	return best;
+}
+
+/*
+ * Window, zero but at samples k1 and k2, whose dot products with references a
+ * and b are equal: x * (ra[k1] - rb[k1]) + y * (ra[k2] - rb[k2]) = 0. False
+ * when they don't fit in a sample or when another reference beats them
+ */
+static bool tie_window(int16_t *window, const int16_t *references,
+		       size_t nb_references, size_t len, size_t a, size_t b,
+		       size_t k1, size_t k2)
+{
+	const int16_t *ra = references + a * len;
+	const int16_t *rb = references + b * len;
+	const int32_t x = (int32_t)rb[k2] - ra[k2];
+	const int32_t y = (int32_t)ra[k1] - rb[k1];
+	if ((x == 0 && y == 0) || x < INT16_MIN || x > INT16_MAX ||
+	    y < INT16_MIN || y > INT16_MAX) {
+		return false;
+	}
+	for (size_t i = 0; i < len; ++i) {
+		window[i] = 0;
+	}
+	window[k1] = x;
+	window[k2] = y;
+
+	const uint64_t tie = dot_product(window, ra, len);
+	if (tie == 0 || tie != dot_product(window, rb, len)) {
+		return false;
+	}
+	for (size_t j = 0; j < nb_references; ++j) {
+		if (dot_product(window, references + j * len, len) > tie) {
+			return false;
+		}
+	}
+	return true;
+}
+
+/* Up to NB_TIE_WINDOWS tie windows, one per pair of references */
+static size_t find_tie_windows(int16_t *windows, const int16_t *references,
+			       size_t nb_references, size_t len)
+{
+	size_t found = 0;
+	for (size_t a = 0; a < nb_references && found < NB_TIE_WINDOWS; ++a) {
+		for (size_t b = a + 1;
+		     b < nb_references && found < NB_TIE_WINDOWS; ++b) {
+			bool tied = false;
+			for (size_t k1 = 0; k1 < len && !tied; ++k1) {
+				for (size_t k2 = k1 + 1; k2 < len && !tied;
+				     ++k2) {
+					tied = tie_window(windows + found * len,
+							  references,
+							  nb_references, len,
+							  a, b, k1, k2);
+				}
+			}
+			if (tied) {
+				found++;
+				/* Next pair on another first reference */
+				break;
+			}
+		}
+	}
+	return found;
+}
+
+int main(int argc, char **argv)
+{
+	if (argc != 2) {
+		printf("Usage: %s vectors.txt\n", argv[0]);
+		return 1;
+	}
+
+	dtmf_t dtmf;
+	if (dtmf_encode(&dtmf, VECTORS_MESSAGE) != DTMF_OK) {
+		printf("Failed to encode the message\n");
+		return 1;
+	}
+	dtmf_decoder_ctx_t *ctx = dtmf_decoder_ctx_create(dtmf.sample_rate);
+	if (!ctx) {
+		printf("Failed to create the decoder\n");
+		buffer_terminate(&dtmf.buffer);
+		return 1;
+	}
+	FILE *file = fopen(argv[1], "w");
+	if (!file) {
+		printf("Failed to open %s\n", argv[1]);
+		dtmf_decoder_ctx_terminate(ctx);
+		buffer_terminate(&dtmf.buffer);
+		return 1;
+	}
+
+	size_t nb_references;
+	size_t len;
+	const int16_t *references =
+		dtmf_decoder_ctx_references(ctx, &nb_references, &len);
+	const int16_t *signal = dtmf.buffer.data;
+	const size_t nb_message_windows =
+		(dtmf.buffer.len - len) / WINDOW_STEP + 1;
+	int16_t *extra = calloc((1 + NB_TIE_WINDOWS) * len, sizeof(*extra));
+	if (!extra) {
+		printf("Failed to allocate the extra windows\n");
+		fclose(file);
+		dtmf_decoder_ctx_terminate(ctx);
+		buffer_terminate(&dtmf.buffer);
+		return 1;
+	}
+	/* extra[0 .. len[ stays the window of zeros */
+	const size_t nb_ties = find_tie_windows(extra + len, references,
+						nb_references, len);
+	const size_t nb_windows = nb_message_windows + 1 + nb_ties;
+
+	fprintf(file, "%zu %zu %zu\n", len, nb_references, nb_windows);
+	for (size_t j = 0; j < nb_references; ++j) {
+		write_samples(file, references + j * len, len);
+	}
+	size_t nb_no_reference = 0;
+	for (size_t i = 0; i < nb_windows; ++i) {
+		const int16_t *window =
+			i < nb_message_windows ?
+				signal + i * WINDOW_STEP :
+				extra + (i - nb_message_windows) * len;
+		if (write_window(file, window, references, nb_references,
+				 len) == NO_REFERENCE) {
+			nb_no_reference++;
+		}
+	}
+	fclose(file);
+	free(extra);
+	printf("%zu windows of %zu samples and %zu references written to %s\n",
+	       nb_windows, len, nb_references, argv[1]);
+	printf("%zu windows without a reference, %zu ties\n", nb_no_reference,
+	       nb_ties);
+
+	dtmf_decoder_ctx_terminate(ctx);
+	buffer_terminate(&dtmf.buffer);
+	return 0;
+}
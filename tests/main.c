@@ -52,7 +52,9 @@
 #define DTMF_DOT_PRODUCT_LOW_OFFSET	       	0x10
 #define DTMF_DOT_PRODUCT_HIGH_OFFSET	    0x14
 #define DTMF_WINDOW_REG_START_OFFSET(n)	    0x100 + (n * 4)
-#define DTMF_REF_REG_START_OFFSET(n)	    0x184 + (n * 4)
+// Reference 0 of the bank, the one a start value of 0 selects
+#define DTMF_REF_REG_START_OFFSET(n)	    0x800 + (n * 4)
+#define DTMF_START_REFERENCE_0		    0x0
 
 #define DTMF_EXPECTED_ID		       			0xCAFE1234
 #define DTMF_IRQ_STATUS_CALCULATION_DONE       	0x01
@@ -214,7 +216,7 @@ bool test_irq_status(volatile void *reg_base)
 	setup_state_machine_for_test_irq(reg_base);
 
 	// Start the calculation
-	write32(reg_base + DTMF_START_CALCULATION_REG_OFFSET, 0x1);
+	write32(reg_base + DTMF_START_CALCULATION_REG_OFFSET, DTMF_START_REFERENCE_0);
 	printf("Waiting for machine to reset\n");
 	fflush(stdout);
 	while (!(read32(reg_base + DTMF_IRQ_STATUS_REG_OFFSET) & DTMF_IRQ_STATUS_CALCULATION_DONE)) {
@@ -271,7 +273,7 @@ bool test_dot_product_calculation(volatile void *reg_base)
 	printf("  Written reference samples: [1, 1, 1, 1, 1, 1, 1, 1]\n");
 	printf("  Expected dot product: 36\n");
 	
-	write32(reg_base + DTMF_START_CALCULATION_REG_OFFSET, 1);
+	write32(reg_base + DTMF_START_CALCULATION_REG_OFFSET, DTMF_START_REFERENCE_0);
 
 	// Wait for completion
 	while (!(read32(reg_base + DTMF_IRQ_STATUS_REG_OFFSET) & DTMF_IRQ_STATUS_CALCULATION_DONE))
@@ -307,7 +309,7 @@ bool test_dot_product_calculation(volatile void *reg_base)
 	printf("  Reference samples: [0, 0, 0, 0, 0, 0, 0, 0]\n");
 	printf("  Expected dot product: 0\n");
 	
-	write32(reg_base + DTMF_START_CALCULATION_REG_OFFSET, 1);
+	write32(reg_base + DTMF_START_CALCULATION_REG_OFFSET, DTMF_START_REFERENCE_0);
 	
 	while (!(read32(reg_base + DTMF_IRQ_STATUS_REG_OFFSET) & DTMF_IRQ_STATUS_CALCULATION_DONE))
 	{
@@ -346,7 +348,7 @@ bool test_dot_product_calculation(volatile void *reg_base)
 	printf("  Reference samples: [1, 2, 3, 4, 5, 6, 7, 8]\n");
 	printf("  Expected dot product: 204\n");
 	
-	write32(reg_base + DTMF_START_CALCULATION_REG_OFFSET, 1);
+	write32(reg_base + DTMF_START_CALCULATION_REG_OFFSET, DTMF_START_REFERENCE_0);
 	
 	while (!(read32(reg_base + DTMF_IRQ_STATUS_REG_OFFSET) & DTMF_IRQ_STATUS_CALCULATION_DONE))
 	{
@@ -388,7 +390,7 @@ bool test_dot_product_calculation(volatile void *reg_base)
 	printf("  Reference samples: [-1, 2, -3, 4, -5, 6, -7, 8]\n");
 	printf("  Expected dot product: -204 (as absolute value: 204)\n");
 	
-	write32(reg_base + DTMF_START_CALCULATION_REG_OFFSET, 1);
+	write32(reg_base + DTMF_START_CALCULATION_REG_OFFSET, DTMF_START_REFERENCE_0);
 	
 	while (!(read32(reg_base + DTMF_IRQ_STATUS_REG_OFFSET) & DTMF_IRQ_STATUS_CALCULATION_DONE))
 	{
@@ -433,7 +435,7 @@ bool test_dot_product_calculation(volatile void *reg_base)
     printf("  Reference samples: [1, 1, 1, 1, ..., 1, 1] (all ones)\n");
     printf("  Expected dot product: %u\n", expected_sum);
     
-    write32(reg_base + DTMF_START_CALCULATION_REG_OFFSET, 1);
+    write32(reg_base + DTMF_START_CALCULATION_REG_OFFSET, DTMF_START_REFERENCE_0);
     
     while (!(read32(reg_base + DTMF_IRQ_STATUS_REG_OFFSET) & DTMF_IRQ_STATUS_CALCULATION_DONE))
     {